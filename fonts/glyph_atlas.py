@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Glyph Atlas Generator
+Rasterizes the printable ASCII glyphs of a monospace TTF into 8x16 coverage masks and writes them
+as a constexpr table for the shape matching glyph mode of ascii_image.
+"""
+
+import argparse
+import sys
+from pathlib import Path
+
+try:
+    from PIL import Image, ImageDraw, ImageFont
+except ImportError as e:
+    print("Error: Required libraries are missing. Install them with: pip install Pillow")
+    print(f"Specific error: {e}")
+    sys.exit(1)
+
+
+CELL_WIDTH = 8
+CELL_HEIGHT = 16
+SUPERSAMPLE = 8
+
+
+def glyph_mask(char, font, threshold):
+    """Render char into a terminal cell and return its coverage mask as (top, bottom) 64 bit words."""
+    width = CELL_WIDTH * SUPERSAMPLE
+    height = CELL_HEIGHT * SUPERSAMPLE
+    image = Image.new('L', (width, height), 0)
+    draw = ImageDraw.Draw(image)
+
+    # Centre the advance horizontally, put the baseline where a terminal would.
+    ascent, descent = font.getmetrics()
+    advance = font.getlength(char)
+    x = (width - advance) / 2
+    y = (height - (ascent + descent)) / 2
+    draw.text((x, y), char, font=font, fill=255)
+
+    # Box filter down to one value per mask bit
+    image = image.resize((CELL_WIDTH, CELL_HEIGHT), Image.Resampling.BOX)
+    pixels = image.load()
+
+    words = [0, 0]
+    for row in range(CELL_HEIGHT):
+        for col in range(CELL_WIDTH):
+            if pixels[col, row] >= threshold * 255:
+                words[row // 8] |= 1 << ((row % 8) * 8 + col)
+    return words
+
+
+def format_header(font_path, masks):
+    lines = []
+    lines.append(f"// Generated by fonts/glyph_atlas.py from {Path(font_path).name}, do not edit.")
+    lines.append("#ifndef GLYPH_ATLAS_HPP")
+    lines.append("#define GLYPH_ATLAS_HPP")
+    lines.append("")
+    lines.append("#include <array>")
+    lines.append("#include <cstdint>")
+    lines.append("")
+    lines.append(f"// {CELL_WIDTH}x{CELL_HEIGHT} coverage of a glyph, row major with the left column in the low bit.")
+    lines.append("// top holds rows 0-7, bottom rows 8-15.")
+    lines.append("struct GlyphShape {")
+    lines.append("    char glyph;")
+    lines.append("    uint64_t top;")
+    lines.append("    uint64_t bottom;")
+    lines.append("};")
+    lines.append("")
+    lines.append(f"constexpr int kGlyphCellWidth = {CELL_WIDTH};")
+    lines.append(f"constexpr int kGlyphCellHeight = {CELL_HEIGHT};")
+    lines.append("")
+    lines.append(f"constexpr std::array<GlyphShape, {len(masks)}> kGlyphAtlas = {{{{")
+    for char, (top, bottom) in masks:
+        literal = "'\\\\'" if char == '\\' else "'\\''" if char == "'" else f"'{char}'"
+        lines.append(f"    {{{literal}, 0x{top:016x}ull, 0x{bottom:016x}ull}},")
+    lines.append("}};")
+    lines.append("")
+    lines.append("#endif")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate the glyph coverage atlas used for shape matching")
+    parser.add_argument('--font', default='/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf',
+                        help='Monospace TTF matching the terminal font')
+    parser.add_argument('-o', '--output', default='include/ascii_image/glyph_atlas.hpp', help='Header to write')
+    parser.add_argument('--threshold', type=float, default=0.3,
+                        help='Coverage a mask bit needs to be set (default: 0.3)')
+    args = parser.parse_args()
+
+    # Size the font so a line fills the cell height
+    size = CELL_HEIGHT * SUPERSAMPLE
+    font = ImageFont.truetype(args.font, size)
+    while sum(font.getmetrics()) > CELL_HEIGHT * SUPERSAMPLE and size > 1:
+        size -= 1
+        font = ImageFont.truetype(args.font, size)
+
+    masks = []
+    seen = set()
+    for code in range(32, 127):
+        char = chr(code)
+        mask = tuple(glyph_mask(char, font, args.threshold))
+        # Glyphs that rasterize identically can never win over the first one
+        if mask in seen:
+            continue
+        seen.add(mask)
+        masks.append((char, mask))
+
+    with open(args.output, 'w', encoding='utf-8') as f:
+        f.write(format_header(args.font, masks))
+    print(f"Created: {args.output} ({len(masks)} glyphs)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,70 @@
+#ifndef BAKED_ASSET_HPP
+#define BAKED_ASSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Pre-baked cell grids, produced offline by ascii_baker and memory mapped at runtime.
+// Needs no OpenCV, the cells are already in AsciiImage's layout (R, G, B, glyph).
+//
+// File layout, little endian:
+//   BakedHeader
+//   BakedLevelEntry[level_count]
+//   cell planes, each starting on a 64 byte boundary, width * height * 4 bytes
+struct BakedHeader {
+    char magic[4];          // "ACGF"
+    uint16_t version;
+    uint16_t level_count;
+    uint32_t flags;         // kBakedGreyscale | kBakedShapeGlyphs
+    uint32_t reserved;
+};
+
+struct BakedLevelEntry {
+    uint32_t width;         // cells per row
+    uint32_t height;        // rows
+    uint64_t offset;        // of the cell plane from the start of the file
+};
+
+constexpr uint16_t kBakedVersion = 1;
+constexpr uint32_t kBakedGreyscale = 1;
+constexpr uint32_t kBakedShapeGlyphs = 2;  // glyphs picked by outline rather than brightness
+
+// One resolution of an asset. cells points into the mapping, width * 4 bytes per row.
+struct BakedLevel {
+    int width = 0;
+    int height = 0;
+    uint8_t* cells = nullptr;
+};
+
+class BakedAsset {
+public:
+    // Maps path privately, pages are only read when touched and writes never reach the file.
+    // Returns nullptr when the file is missing or malformed.
+    static std::shared_ptr<BakedAsset> open(const std::string& path);
+    static bool write(const std::string& path, const std::vector<BakedLevel>& levels, uint32_t flags);
+
+    ~BakedAsset();
+    BakedAsset(const BakedAsset&) = delete;
+    BakedAsset& operator=(const BakedAsset&) = delete;
+
+    uint32_t flags() const;
+    bool greyscale() const;
+    const std::vector<BakedLevel>& levels() const;
+    // Exact size match, or nullptr.
+    const BakedLevel* find(int width, int height) const;
+    // Largest level fitting inside width x height, or nullptr.
+    const BakedLevel* fit(int width, int height) const;
+
+private:
+    BakedAsset() = default;
+
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    uint32_t flags_ = 0;
+    std::vector<BakedLevel> levels_;
+};
+
+#endif
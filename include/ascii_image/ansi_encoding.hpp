@@ -0,0 +1,100 @@
+#ifndef ANSI_ENCODING_HPP
+#define ANSI_ENCODING_HPP
+
+#include <array>
+#include <cstring>
+#include "palette.hpp"
+
+// Raw escape code writers shared by the serializers. Each writes into a buffer
+// the caller has already sized and returns the new end.
+namespace ansi_encoding {
+
+// "\033[38;2;255;255;255m" plus the glyph.
+constexpr size_t kMaxCellBytes = 20;
+// "\033[9999;9999H"
+constexpr size_t kMaxCursorBytes = 12;
+
+struct DecimalNumber {
+    char digits[4];
+    unsigned char length;
+};
+
+constexpr DecimalNumber make_decimal(int v) {
+    DecimalNumber d{};
+    int length = 1;
+    for (int rest = v / 10; rest > 0; rest /= 10) {
+        ++length;
+    }
+    for (int i = length - 1; i >= 0; --i, v /= 10) {
+        d.digits[i] = static_cast<char>('0' + v % 10);
+    }
+    d.length = static_cast<unsigned char>(length);
+    return d;
+}
+
+// Decimal text of every byte value, so no per-cell integer formatting is needed.
+constexpr std::array<DecimalNumber, 256> make_decimal_table() {
+    std::array<DecimalNumber, 256> table{};
+    for (int v = 0; v < 256; ++v) {
+        table[v] = make_decimal(v);
+    }
+    return table;
+}
+
+inline constexpr std::array<DecimalNumber, 256> kDecimal = make_decimal_table();
+
+inline char* put_literal(char* out, const char* text, size_t length) {
+    std::memcpy(out, text, length);
+    return out + length;
+}
+
+inline char* put_byte(char* out, unsigned char v) {
+    const DecimalNumber& d = kDecimal[v];
+    std::memcpy(out, d.digits, 3);
+    return out + d.length;
+}
+
+inline char* put_number(char* out, int v) {
+    if (v < 256) {
+        return put_byte(out, static_cast<unsigned char>(v));
+    }
+    const DecimalNumber d = make_decimal(v < 9999 ? v : 9999);
+    std::memcpy(out, d.digits, 4);
+    return out + d.length;
+}
+
+// Truecolor foreground, ESC[38;2;r;g;bm
+inline char* put_rgb(char* out, unsigned char r, unsigned char g, unsigned char b) {
+    out = put_literal(out, "\033[38;2;", 7);
+    out = put_byte(out, r);
+    *out++ = ';';
+    out = put_byte(out, g);
+    *out++ = ';';
+    out = put_byte(out, b);
+    *out++ = 'm';
+    return out;
+}
+
+// Cached palette code, copied at its padded size so the copy doesn't depend on the length
+inline char* put_code(char* out, const PaletteCode& code) {
+    std::memcpy(out, code.bytes, sizeof(code.bytes));
+    return out + code.length;
+}
+
+// Cursor position, 0 based, ESC[row;colH
+inline char* put_cursor(char* out, int row, int col) {
+    out = put_literal(out, "\033[", 2);
+    out = put_number(out, row + 1);
+    *out++ = ';';
+    out = put_number(out, col + 1);
+    *out++ = 'H';
+    return out;
+}
+
+inline char* put_reset(char* out) {
+    return put_literal(out, "\033[0m", 4);
+}
+
+}  // namespace ansi_encoding
+
+#endif
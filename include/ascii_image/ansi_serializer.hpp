@@ -0,0 +1,36 @@
+#ifndef ANSI_SERIALIZER_HPP
+#define ANSI_SERIALIZER_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include <sys/uio.h>
+
+class AsciiImage;
+
+// Encodes AsciiImages into terminal escape codes using reusable byte buffers.
+// A colour code is only written when the colour differs from the previous cell,
+// and a single reset closes the frame.
+// Large images are encoded in row bands on several threads, each band into its
+// own buffer; segments() lists them in order so they can be written without joining.
+class AnsiSerializer {
+public:
+    AnsiSerializer();
+
+    // Replaces the buffer contents with the encoding of image.
+    void encode(const AsciiImage& image);
+    // Writes the last encoded frame with one write and one flush.
+    void write(std::ostream& os) const;
+    // Writes the last encoded frame with one writev call, looping only on partial writes.
+    bool write(int fd) const;
+
+    const std::vector<iovec>& segments() const;
+    size_t encoded_bytes() const; // size of the last encoded frame
+
+private:
+    std::vector<std::vector<char>> bands_;
+    std::vector<iovec> segments_;
+    size_t size_ = 0;
+};
+
+#endif
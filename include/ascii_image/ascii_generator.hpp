@@ -2,27 +2,121 @@
 #define ASCII_GENERATOR_HPP
 
 #include <string>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <ascii_image.hpp>
+#include <dither.hpp>
+#include <glyph_matcher.hpp>
+#include <tone_map.hpp>
 #include <opencv2/opencv.hpp>
+
+// Counters for the decoded-image and finished-image caches of AsciiGenerator.
+struct AsciiCacheStats {
+    size_t decode_hits = 0;
+    size_t decode_misses = 0;
+    size_t source_entries = 0;
+    size_t source_bytes = 0;
+    size_t result_hits = 0;
+    size_t result_misses = 0;
+    size_t result_entries = 0;
+    size_t result_bytes = 0;
+    size_t baked_hits = 0;
+};
+
 class AsciiGenerator {
 public:
     AsciiGenerator();
     
-    AsciiImage generate_ascii_from_file(const std::string& image_path, int width = -1, int height = -1);
+    using CancelCheck = std::function<bool()>;
+
+    AsciiImage generate_ascii_from_file(const std::string& image_path, int width = -1, int height = -1, bool greyscale = false);
+    // Same as above, but gives up between stages once cancelled() returns true. Returns false and leaves
+    // out untouched when cancelled or when the image can't be read.
+    // lut, when given, receives the brightness to glyph table out was made with, e.g. to light it later.
+    bool generate_ascii_from_file(const std::string& image_path, int width, int height, bool greyscale,
+                                  const CancelCheck& cancelled, AsciiImage& out, GlyphLut* lut = nullptr);
     void set_desired_dimensions(int width, int height);
+    // A baked <image>.acg next to the image is used when it has a level of the requested size.
+    // With prefer_baked the largest level that fits inside the request is taken instead of decoding.
+    void set_prefer_baked(bool prefer_baked);
+    // Off always converts from the image, as the baker does so it never reads its own output back.
+    void set_use_baked(bool use_baked);
+    void set_glyph_mode(GlyphMode mode);
+    // Contrast, gamma, ramp and exposure of later conversions. Drops cached results, and baked
+    // assets (made with the default tone) are no longer used.
+    void set_tone(const ToneSettings& settings);
+    // Dithers later conversions, colours against palette (Ansi256 and Ansi16 only). Drops cached
+    // results, and baked assets are no longer used while a mode is set.
+    void set_dither(DitherMode mode, PaletteMode palette = PaletteMode::TrueColor);
+
+    // Memory allowed for finished images, least recently used ones are evicted first.
+    void set_cache_budget(size_t bytes);
+    // Memory allowed for decoded source images, kept apart so large stills don't push out results.
+    void set_source_budget(size_t bytes);
+    AsciiCacheStats cache_stats() const;
+    void clear_cache();
 
 private:
-    int contrast_;
-    int default_width_ = -1;
-    int default_height_ = -1;
-    std::string density_;
+    struct SourceEntry {
+        std::string path;
+        std::filesystem::file_time_type mtime;
+        cv::Mat image;
+        size_t bytes;
+    };
+    struct BakedEntry {
+        std::filesystem::file_time_type mtime;
+        std::shared_ptr<BakedAsset> asset; // nullptr when the file didn't parse
+    };
+    struct ResultKey {
+        std::string path;
+        int width;
+        int height;
+        bool greyscale;
+        GlyphMode mode;
+        bool operator==(const ResultKey& other) const;
+    };
+    struct ResultKeyHash {
+        size_t operator()(const ResultKey& key) const;
+    };
+    struct ResultEntry {
+        ResultKey key;
+        std::filesystem::file_time_type mtime;
+        AsciiImage image;
+        GlyphLut lut;
+        size_t bytes;
+    };
 
-    
-    void initialize_density();
-    char get_ascii_char(int brightness) const;
+    cv::Mat load_source(const std::string& image_path, std::filesystem::file_time_type mtime, bool cacheable);
+    bool load_baked(const std::string& image_path, const std::filesystem::file_time_type* source_mtime, int width,
+                    int height, AsciiImage& out);
+    void store_result(ResultKey key, std::filesystem::file_time_type mtime, const AsciiImage& image, const GlyphLut& lut,
+                      uint64_t generation);
+    void evict_sources(size_t incoming);
 
+    int default_width_ = -1;
+    int default_height_ = -1;
 
+    mutable std::mutex cache_mutex_;
+    std::list<SourceEntry> sources_; // most recently used first
+    std::unordered_map<std::string, std::list<SourceEntry>::iterator> source_index_;
+    size_t source_budget_ = 64 * 1024 * 1024;
+    std::unordered_map<std::string, BakedEntry> baked_;
+    bool prefer_baked_ = false;
+    bool use_baked_ = true;
+    GlyphMode glyph_mode_ = GlyphMode::Brightness;
+    ToneMapper tone_;
+    bool custom_tone_ = false;
+    uint64_t settings_generation_ = 0; // bumped by settings missing from ResultKey
+    DitherMode dither_ = DitherMode::None;
+    PaletteMode dither_palette_ = PaletteMode::TrueColor;
+    std::list<ResultEntry> results_; // most recently used first
+    std::unordered_map<ResultKey, std::list<ResultEntry>::iterator, ResultKeyHash> result_index_;
+    size_t cache_budget_ = 64 * 1024 * 1024;
+    AsciiCacheStats stats_;
 };
 
 
-#endif
\ No newline at end of file
+#endif
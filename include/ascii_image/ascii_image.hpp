@@ -2,9 +2,14 @@
 #define ASCII_IMAGE_HPP
 #include <opencv2/opencv.hpp>
 #include <color_utils.hpp>
+#include <baked_asset.hpp>
+#include <palette.hpp>
 #include <iostream>
+#include <memory>
 
 
+// Cell storage is shared between copies, crops and translated views; it is only
+// duplicated when a shared image is about to be written through mutable_cells().
 struct AsciiImageData{
     AsciiImageData(){
 
@@ -15,41 +20,52 @@ struct AsciiImageData{
     }
 cv::Mat4b mat_;
 bool greyscale = false;
+PaletteMode palette = PaletteMode::TrueColor;
+std::shared_ptr<const void> owner; // keeps borrowed cell memory (a baked asset mapping) alive
 };
 
 class AsciiImage{
 
 public:
 
-AsciiImage(cv::Mat3b img_matrix, float horizontal_scale_factor=3);
+static constexpr float default_horizontal_scale = 3;
+
+AsciiImage(cv::Mat3b img_matrix, float horizontal_scale_factor=default_horizontal_scale);
+// Converts an RGB image straight into cells, each source pixel stretched over horizontal_scale_factor columns.
+AsciiImage(const cv::Mat3b& img_matrix, float horizontal_scale_factor, const GlyphLut& lut);
 AsciiImage(AsciiImageData data);
-cv::Mat get_matrix();
+// Wraps one level of a mapped asset without copying, the asset stays mapped while any copy lives.
+AsciiImage(std::shared_ptr<BakedAsset> asset, const BakedLevel& level);
+const cv::Mat4b& get_matrix() const;
+const cv::Mat4b& get_cells() const;
+// Cells for writing. Copies them first if any other image (or a baked asset mapping) can see them.
+cv::Mat4b& mutable_cells();
+// Gives this image its own storage if it shares any.
+void detach();
+// True while other copies hold the cells. Safe while other threads drop their copies.
+bool is_shared() const;
+bool is_greyscale() const;
 void print();
 void set_greyscale(bool grey);
+// Colour depth used when the image is written to a terminal.
+void set_palette(PaletteMode palette);
+PaletteMode get_palette() const;
+// Whether any colour codes are written, false for greyscale and Mono.
+bool has_color() const;
 
-AsciiImage crop(int x, int y, int size_x, int size_y);
-AsciiImage scale(float x_scale, float y_scale);
+// View of a region sharing this image's cells, clipped to the image. Doesn't allocate.
+AsciiImage crop(int x, int y, int size_x, int size_y) const &;
+AsciiImage crop(int x, int y, int size_x, int size_y) &&;
+// Moves a cropped view over its parent's cells, stopping at the parent's edges. Doesn't allocate.
+AsciiImage& translate(int dx, int dy);
+AsciiImage scale(float x_scale, float y_scale) const;
 // AsciiImage Filter(int r, int g, int b)
 
 
 
 
-friend std::ostream& operator<< (std::ostream& os, const AsciiImage& mat){
-    for (int i = 0; i < mat.data.mat_.rows; ++i) {
-        for (int j = 0; j < mat.data.mat_.cols; ++j) {
-            const cv::Vec4b& v = mat.data.mat_.at<cv::Vec4b>(i, j);
-            std::string color_code, reset_code;
-            if(!mat.data.greyscale){
-                color_code = ColorUtils::rgb_to_ansi(v[0], v[1], v[2]);
-                reset_code = ColorUtils::reset_color();
-            }
-            os << color_code << static_cast<char>(v[3]) << reset_code;
-            
-        }
-        os << std::endl;
-    }
-    return(os);
-}
+// Encodes through a per-thread AnsiSerializer and flushes once per image.
+friend std::ostream& operator<< (std::ostream& os, const AsciiImage& mat);
 private:
 AsciiImageData data;
 };
@@ -0,0 +1,117 @@
+#ifndef ASCII_VIDEO_HPP
+#define ASCII_VIDEO_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ascii_image.hpp>
+#include <bounded_queue.hpp>
+#include <dither.hpp>
+#include <glyph_matcher.hpp>
+#include <tone_map.hpp>
+#include <opencv2/opencv.hpp>
+
+struct AsciiFrame {
+    AsciiImage image = AsciiImage(AsciiImageData());
+    double timestamp = 0;  // seconds from the start of playback
+    size_t index = 0;
+    GlyphLut lut{};             // brightness to glyph table the cells were made with
+    bool shape_glyphs = false;  // glyphs were matched by shape, not picked from lut
+};
+
+struct VideoPipelineStats {
+    size_t decode_queue_depth = 0;
+    size_t present_queue_depth = 0;
+    size_t decoded_frames = 0;
+    size_t converted_frames = 0;
+    size_t presented_frames = 0;
+    size_t dropped_rate = 0;   // skipped by the decoder to honour the target frame rate
+    size_t dropped_late = 0;   // skipped by the converter because they were already overdue
+    size_t dropped_stale = 0;  // converted, but a newer frame was due by the time they were presented
+};
+
+// Plays a video file, a printf style image sequence ("frames/%04d.png") or a glob
+// ("frames/*.png") as AsciiImages.
+// A decode thread feeds a bounded queue, a conversion thread turns decoded frames into
+// AsciiImages at the current output size and feeds a second bounded queue that the
+// presenter drains by timestamp.
+class AsciiVideoSource {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    AsciiVideoSource(size_t decode_capacity = 8, size_t present_capacity = 4);
+    ~AsciiVideoSource();
+
+    // target_fps <= 0 plays at the source rate.
+    bool open(const std::string& source, double target_fps = 0);
+    void close();
+    bool is_open() const;
+    // True once the source is exhausted and every converted frame was handed out.
+    bool finished() const;
+
+    void set_output_size(int width, int height);
+    void set_loop(bool loop);
+    void set_glyph_mode(GlyphMode mode);
+    // Applied from the next converted frame on, auto exposure is smoothed across frames.
+    void set_tone(const ToneSettings& settings);
+    // Applied from the next converted frame on. Ordered keeps still areas still, the error
+    // diffusion modes shimmer wherever the source changes.
+    void set_dither(DitherMode mode, PaletteMode palette = PaletteMode::TrueColor);
+
+    // Hands out the newest frame that is due at now. Frames that were due earlier are dropped.
+    bool frame_for(Clock::time_point now, AsciiFrame& frame);
+    // When the next frame will be due.
+    Clock::time_point next_deadline(Clock::time_point now) const;
+
+    VideoPipelineStats stats() const;
+
+private:
+    struct DecodedFrame {
+        cv::Mat image;
+        double timestamp = 0;
+        size_t index = 0;
+    };
+
+    void decode_loop();
+    void convert_loop();
+    bool read_frame(cv::Mat& out);
+    bool rewind();
+    double playback_time(Clock::time_point now) const;
+
+    BoundedQueue<DecodedFrame> decoded_;
+    BoundedQueue<AsciiFrame> converted_;
+    std::thread decode_thread_;
+    std::thread convert_thread_;
+
+    cv::VideoCapture capture_;
+    std::vector<std::string> files_;
+    size_t file_index_ = 0;
+    double source_fps_ = 0;
+    double target_fps_ = 0;
+
+    std::atomic<bool> open_{false};
+    std::atomic<bool> running_{false};
+    std::atomic<bool> convert_done_{false};
+    std::atomic<bool> loop_{false};
+    std::atomic<GlyphMode> glyph_mode_{GlyphMode::Brightness};
+    std::mutex tone_mutex_;
+    ToneSettings tone_settings_;
+    std::atomic<bool> tone_changed_{false};
+    std::atomic<DitherMode> dither_mode_{DitherMode::None};
+    std::atomic<PaletteMode> dither_palette_{PaletteMode::TrueColor};
+    std::atomic<int> out_width_{-1};
+    std::atomic<int> out_height_{-1};
+    std::atomic<Clock::rep> start_{0};  // clock time at which timestamp 0 is due, 0 before the first frame
+
+    std::atomic<size_t> decoded_frames_{0};
+    std::atomic<size_t> converted_frames_{0};
+    std::atomic<size_t> presented_frames_{0};
+    std::atomic<size_t> dropped_rate_{0};
+    std::atomic<size_t> dropped_late_{0};
+    std::atomic<size_t> dropped_stale_{0};
+};
+
+#endif
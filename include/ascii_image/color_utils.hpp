@@ -1,17 +1,22 @@
 #ifndef COLOUR_UTILS_HPP
 #define COLOUR_UTILS_HPP
 
+#include <array>
 #include <string>
 
+// Brightness (0-255) to glyph lookup, one entry per possible brightness value.
+using GlyphLut = std::array<char, 256>;
+
 class ColorUtils {
 public:
     static std::string rgb_to_ansi(int r, int g, int b);
     static std::string reset_color();
     static char get_ascii_char(int brightness);
+    static const GlyphLut& glyph_lut(); // get_ascii_char for every brightness, built once
     static inline const std::string full_density_range = "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'.            ";
 
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,98 @@
+#ifndef COMPOSITOR_HPP
+#define COMPOSITOR_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <ascii_image.hpp>
+
+// Stacks AsciiImage layers (a background, sprites, overlays) into one cell grid.
+// Layers are drawn in z order, cells matching a layer's transparency key glyph let
+// the layers below show through.
+// Only rectangles touched since the last compose are redrawn, so a frame where one
+// sprite moved costs about twice that sprite's area whatever the grid size.
+// The grid is kept as separate r, g, b and glyph planes, blending a layer row is a
+// few contiguous masked selects; it is packed back into cells only where it changed.
+// Output grids rotate, so a frame still held by its reader is left alone. Each grid
+// is brought up to date by packing the rectangles changed since it was last used.
+class Compositor {
+public:
+    using LayerId = int;
+
+    Compositor();
+    explicit Compositor(cv::Size size);
+
+    // Changes the grid size, everything is redrawn on the next compose.
+    void resize(cv::Size size);
+    cv::Size size() const;
+
+    // Adds a layer with its top left cell at position, ties in z are drawn in the order added.
+    LayerId add_layer(const AsciiImage& image, cv::Point position = cv::Point(), int z = 0,
+                      std::optional<uint8_t> key = std::nullopt);
+    void remove_layer(LayerId id);
+    // Images are shared, not copied. Later writes through the caller's copy detach it and
+    // aren't seen here until set_image is called again.
+    void set_image(LayerId id, const AsciiImage& image);
+    void set_position(LayerId id, cv::Point position);
+    void set_z(LayerId id, int z);
+    // Glyph drawn as transparent, nullopt makes the layer opaque.
+    void set_key(LayerId id, std::optional<uint8_t> key);
+    void set_visible(LayerId id, bool visible);
+    // Marks part of the grid, or all of it, for redrawing.
+    void invalidate(const cv::Rect& region);
+    void invalidate();
+
+    // Redraws the dirty rectangles, returns false when nothing was dirty.
+    bool compose();
+    // Composited cells. Copies share storage; compose moves on to a grid nobody holds, and only
+    // copies one when every grid is still held.
+    const AsciiImage& image() const;
+    // Rectangles the last compose redrew.
+    const std::vector<cv::Rect>& composed_rects() const;
+    // Composes that found every output grid still held and had to copy one, 0 in steady state.
+    size_t copied_grids() const;
+
+private:
+    struct Layer {
+        AsciiImage image = AsciiImage(AsciiImageData());
+        cv::Point position;
+        int z = 0;
+        std::optional<uint8_t> key;
+        bool visible = true;
+        bool alive = false;
+        uint64_t sequence = 0;   // breaks ties in z
+
+        cv::Rect bounds() const;
+    };
+    struct Output {
+        AsciiImage image = AsciiImage(AsciiImageData());
+        std::vector<cv::Rect> stale;   // changed since this grid was last packed
+    };
+
+    Layer& layer(LayerId id);
+    void mark(const Layer& layer);
+    void sort_layers();
+    void compose_rect(const cv::Rect& rect);
+    void pack_rect(const cv::Rect& rect, cv::Mat4b& cells) const;
+
+    cv::Size size_;
+    // Planes, row major over the whole grid
+    std::vector<uint8_t> red_;
+    std::vector<uint8_t> green_;
+    std::vector<uint8_t> blue_;
+    std::vector<uint8_t> glyph_;
+    std::vector<Output> outputs_;
+    size_t current_ = 0;
+    size_t copied_ = 0;
+
+    std::vector<Layer> layers_;
+    std::vector<LayerId> free_ids_;
+    std::vector<LayerId> order_;     // live, visible layers bottom to top
+    bool order_valid_ = true;
+    uint64_t next_sequence_ = 0;
+
+    std::vector<cv::Rect> dirty_;
+    std::vector<cv::Rect> composed_;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef DITHER_HPP
+#define DITHER_HPP
+
+#include <ascii_image.hpp>
+#include <color_utils.hpp>
+
+// How brightness between two glyph levels (and colour between two palette entries) is spread.
+enum class DitherMode {
+    None,            // nearest level, bands in smooth gradients
+    Ordered,         // 8x8 Bayer threshold pattern, stable from frame to frame
+    FloydSteinberg,  // error diffusion, finest detail but patterns crawl on moving sources
+    Atkinson         // error diffusion losing a quarter of the error, keeps more contrast in the darks
+};
+
+namespace dither {
+
+// Dithers image in place: the glyphs between the levels of lut, and for Ansi256 and Ansi16
+// images the colours between the palette's entries, so set the palette first.
+// Glyphs are picked again from each cell's colour, pass glyphs = false for cells whose glyphs
+// came from shape matching.
+void apply(AsciiImage& image, DitherMode mode, const GlyphLut& lut, bool glyphs = true);
+
+}  // namespace dither
+
+#endif
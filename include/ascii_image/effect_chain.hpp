@@ -0,0 +1,60 @@
+#ifndef EFFECT_CHAIN_HPP
+#define EFFECT_CHAIN_HPP
+
+#include <cstdint>
+#include <vector>
+#include <ascii_image.hpp>
+
+// Post-processing applied to a finished frame. What amount means depends on the kind.
+enum class EffectKind {
+    Flicker,          // amount: deepest dip in brightness, 0 to 1, a new dip every frame
+    Noise,            // amount: static added to every cell's colour, 0 to 1 of full range
+    Vignette,         // amount: darkening at the corners, 0 to 1
+    ChromaticShift,   // amount: cells red is shifted right and blue left
+    ScanlineRoll,     // amount: rows the picture rolls up per frame
+    GlyphCorruption   // amount: share of cells whose glyph is replaced by junk, 0 to 1
+};
+
+struct Effect {
+    EffectKind kind;
+    float amount;
+};
+
+// Effects declared for a scene. However many there are they are merged into one set
+// of parameters and applied in a single pass over each row: the row is split into
+// colour and glyph planes once, every effect works on the planes, and it is packed
+// back once. Five effects cost little more than one.
+// Randomness is a hash of the seed, the frame number and the cell, so a frame looks
+// the same every time it is drawn and no generator state is shared between threads.
+class EffectChain {
+public:
+    EffectChain();
+
+    // Effects of the same kind add up.
+    EffectChain& add(EffectKind kind, float amount);
+    void clear();
+    bool empty() const;
+    const std::vector<Effect>& effects() const;
+    void set_seed(uint64_t seed);
+
+    // Writes source with every effect applied into out. out gets new storage if it's
+    // shared or a different size, otherwise it is overwritten in place.
+    void apply(const AsciiImage& source, uint64_t frame, AsciiImage& out) const;
+
+private:
+    // The effect list folded into one value per kind.
+    struct Fused {
+        float flicker = 0;
+        float noise = 0;
+        float vignette = 0;
+        float shift = 0;
+        float roll = 0;
+        float corruption = 0;
+    };
+
+    std::vector<Effect> effects_;
+    Fused fused_;
+    uint64_t seed_ = 0x5eed;
+};
+
+#endif
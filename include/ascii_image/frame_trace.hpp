@@ -0,0 +1,69 @@
+#ifndef FRAME_TRACE_HPP
+#define FRAME_TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped stage timers for finding where frame time goes. Each thread records into its
+// own ring of the last kRingSize events, made on its first event; while tracing is
+// disabled a Scope only checks one relaxed atomic flag.
+//
+//     frame_trace::Scope scope("resize");
+namespace frame_trace {
+
+constexpr size_t kRingSize = 4096;
+
+struct Event {
+    const char* name; // string literal, compared by content
+    int64_t begin_ns; // since the first trace call of the process
+    int64_t end_ns;
+};
+
+struct StageStats {
+    std::string name;
+    double p50_ms = 0;
+    double p99_ms = 0;
+    size_t count = 0;
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+void set_enabled(bool enabled);
+// Shown as the thread's name in exported traces.
+void set_thread_name(const std::string& name);
+
+int64_t now_ns();
+void record(const char* name, int64_t begin_ns, int64_t end_ns);
+
+class Scope {
+public:
+    explicit Scope(const char* name) : name_(name), begin_ns_(enabled() ? now_ns() : -1) {
+    }
+    ~Scope() {
+        if (begin_ns_ >= 0) {
+            record(name_, begin_ns_, now_ns());
+        }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name_;
+    int64_t begin_ns_;
+};
+
+// Percentiles per stage name over the events still held by all threads, sorted by name.
+std::vector<StageStats> stage_stats();
+// Writes all held events as Chrome trace-event JSON (chrome://tracing, Perfetto).
+bool write_chrome_trace(const std::string& path);
+void clear();
+
+}  // namespace frame_trace
+
+#endif
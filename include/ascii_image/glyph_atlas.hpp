@@ -0,0 +1,117 @@
+// Generated by fonts/glyph_atlas.py from DejaVuSansMono.ttf, do not edit.
+#ifndef GLYPH_ATLAS_HPP
+#define GLYPH_ATLAS_HPP
+
+#include <array>
+#include <cstdint>
+
+// 8x16 coverage of a glyph, row major with the left column in the low bit.
+// top holds rows 0-7, bottom rows 8-15.
+struct GlyphShape {
+    char glyph;
+    uint64_t top;
+    uint64_t bottom;
+};
+
+constexpr int kGlyphCellWidth = 8;
+constexpr int kGlyphCellHeight = 16;
+
+constexpr std::array<GlyphShape, 95> kGlyphAtlas = {{
+    {' ', 0x0000000000000000ull, 0x0000000000000000ull},
+    {'!', 0x1818181818000000ull, 0x0000001818000018ull},
+    {'"', 0x0024343434000000ull, 0x0000000000000000ull},
+    {'#', 0x2cfe6c6858000000ull, 0x0000001212167f34ull},
+    {'$', 0x1e16167c10000000ull, 0x0010103c7e50507cull},
+    {'%', 0x7ecf190b06000000ull, 0x00000070d098f26eull},
+    {'&', 0x0e0c06063c180000ull, 0x000000fe66e3f39bull},
+    {'\'', 0x0018181818000000ull, 0x0000000000000000ull},
+    {'(', 0x0808181810300000ull, 0x0020101818080808ull},
+    {')', 0x1010181808040000ull, 0x0004081818101010ull},
+    {'*', 0x5a3c187e18000000ull, 0x0000000000000018ull},
+    {'+', 0x1818180000000000ull, 0x00000000181818ffull},
+    {',', 0x0000000000000000ull, 0x0008081818000000ull},
+    {'-', 0x0000000000000000ull, 0x0000000000003c3cull},
+    {'.', 0x0000000000000000ull, 0x0000001818000000ull},
+    {'/', 0x1830302060000000ull, 0x00000206040c0818ull},
+    {'0', 0x5a4266663c180000ull, 0x0000003c6666425aull},
+    {'1', 0x101010181e000000ull, 0x0000007c7c101010ull},
+    {'2', 0x306060623e080000ull, 0x0000007e7e0c1810ull},
+    {'3', 0x3c7060603e080000ull, 0x0000003e72606060ull},
+    {'4', 0x2624283830000000ull, 0x00000020207eff22ull},
+    {'5', 0x763e06063e000000ull, 0x0000003e72606060ull},
+    {'6', 0x7e3a02067c100000ull, 0x0000003c66464246ull},
+    {'7', 0x303020607e000000ull, 0x0000000c0c181810ull},
+    {'8', 0x3c6666667e180000ull, 0x0000003c66424266ull},
+    {'9', 0x666262663e180000ull, 0x0000003e3060587eull},
+    {':', 0x1818000000000000ull, 0x0000001818000000ull},
+    {';', 0x1818000000000000ull, 0x0008081818000000ull},
+    {'<', 0x1e78c00000000000ull, 0x00000000c0701e07ull},
+    {'=', 0xff7e000000000000ull, 0x00000000007eff00ull},
+    {'>', 0x780e030000000000ull, 0x00000000030f78e0ull},
+    {'?', 0x183060603e180000ull, 0x0000001818001818ull},
+    {'@', 0xf9f3c27c38000000ull, 0x00780e02fbc98dcdull},
+    {'A', 0x24343c1c18000000ull, 0x000000c3c3667e66ull},
+    {'B', 0x3e6646663e000000ull, 0x0000003e7ec6c666ull},
+    {'C', 0x020206067c300000ull, 0x000000784c060602ull},
+    {'D', 0x424262723e000000ull, 0x0000001e3e626242ull},
+    {'E', 0x7e0606067e000000ull, 0x0000007e7e060606ull},
+    {'F', 0x7e0606067e000000ull, 0x0000000606060606ull},
+    {'G', 0x630302467c100000ull, 0x0000007c6e464273ull},
+    {'H', 0x7e42424242000000ull, 0x0000004242424242ull},
+    {'I', 0x181818187e000000ull, 0x0000007e3c181818ull},
+    {'J', 0x202020203c000000ull, 0x0000001e33202020ull},
+    {'K', 0x1e1e3262c2000000ull, 0x000000c26262321eull},
+    {'L', 0x0606060606000000ull, 0x000000fe7e060606ull},
+    {'M', 0xdbffe7e7e7000000ull, 0x000000c3c3c3c3dbull},
+    {'N', 0x5a4a4e4646000000ull, 0x000000626272725aull},
+    {'O', 0x434262663c180000ull, 0x0000003c66664243ull},
+    {'P', 0x66c6c6667e000000ull, 0x000000060606063eull},
+    {'Q', 0x434262663c180000ull, 0x0000603c66664243ull},
+    {'R', 0x3e6262623e000000ull, 0x000000c2c262623eull},
+    {'S', 0x3e0602067e180000ull, 0x0000003e66404070ull},
+    {'T', 0x18181818ff000000ull, 0x0000001818181818ull},
+    {'U', 0x4242424242000000ull, 0x0000003c66424242ull},
+    {'V', 0x66666642c3000000ull, 0x00000018183c3c24ull},
+    {'W', 0xdbdbc3c3c1000000ull, 0x0000006666667e5eull},
+    {'X', 0x183c2c66c2000000ull, 0x000000c342663c3cull},
+    {'Y', 0x183c2666c3000000ull, 0x0000001818181818ull},
+    {'Z', 0x18306060fe000000ull, 0x000000fe7e040c18ull},
+    {'[', 0x0808080818380000ull, 0x0038380808080808ull},
+    {'\\', 0x080c040602000000ull, 0x0000602030301818ull},
+    {']', 0x101010101c1c0000ull, 0x001c1c1010101010ull},
+    {'^', 0x0042663c18000000ull, 0x0000000000000000ull},
+    {'_', 0x0000000000000000ull, 0xff00000000000000ull},
+    {'`', 0x00000000080c0000ull, 0x0000000000000000ull},
+    {'a', 0x60623e0000000000ull, 0x0000007e6662667cull},
+    {'b', 0x46663e0606020000ull, 0x0000003e66464646ull},
+    {'c', 0x064c780000000000ull, 0x000000784c060606ull},
+    {'d', 0x62667c6060400000ull, 0x0000007c66626262ull},
+    {'e', 0x42663c0000000000ull, 0x0000007c4602027eull},
+    {'f', 0x18187e1878700000ull, 0x0000000818181818ull},
+    {'g', 0x62667c0000000000ull, 0x1c3e607c7e626262ull},
+    {'h', 0x66663e0606020000ull, 0x0000004266666666ull},
+    {'i', 0x18181e0018180000ull, 0x0000007e18181818ull},
+    {'j', 0x10181c0010100000ull, 0x0e1e101010101010ull},
+    {'k', 0x1e36660606060000ull, 0x000000c66626361eull},
+    {'l', 0x080808080e0e0000ull, 0x0000007018080808ull},
+    {'m', 0xdb5b7f0000000000ull, 0x000000dbdbdbdbdbull},
+    {'n', 0x66663e0000000000ull, 0x0000004266666666ull},
+    {'o', 0x62663c0000000000ull, 0x0000003c66624242ull},
+    {'p', 0x46663e0000000000ull, 0x0206063e66464646ull},
+    {'q', 0x62667c0000000000ull, 0x4060607c66626262ull},
+    {'r', 0x0c9cfc0000000000ull, 0x0000000c0c0c0c0cull},
+    {'s', 0x06063c0000000000ull, 0x0000003e6260783cull},
+    {'t', 0x080c7e0808000000ull, 0x0000007818080808ull},
+    {'u', 0x6666420000000000ull, 0x0000007c66666666ull},
+    {'v', 0x6642420000000000ull, 0x00000018183c3426ull},
+    {'w', 0xdbc3810000000000ull, 0x00000066667e5adbull},
+    {'x', 0x3c66420000000000ull, 0x00000042663c1818ull},
+    {'y', 0x6646c20000000000ull, 0x060e1818183c3c64ull},
+    {'z', 0x30607e0000000000ull, 0x0000007e060c1810ull},
+    {'{', 0x1818181838700000ull, 0x007018181818180eull},
+    {'|', 0x1818181818180000ull, 0x1818181818181818ull},
+    {'}', 0x181818181c0e0000ull, 0x000e181818181870ull},
+    {'~', 0x0e00000000000000ull, 0x00000000000020ffull},
+}};
+
+#endif
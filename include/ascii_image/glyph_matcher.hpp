@@ -0,0 +1,28 @@
+#ifndef GLYPH_MATCHER_HPP
+#define GLYPH_MATCHER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <color_utils.hpp>
+#include <cstdint>
+
+// How a cell's glyph is picked.
+enum class GlyphMode {
+    Brightness, // mean brightness through the density ramp
+    Shape       // closest glyph outline from glyph_atlas.hpp, sharper edges and silhouettes
+};
+
+namespace glyph_matcher {
+
+// Source size needed for a cell grid of columns x rows in Shape mode, one atlas cell of pixels per cell.
+cv::Size detail_size(int columns, int rows);
+
+// Converts an RGB image of detail_size(columns, rows) into cells. Each cell is thresholded at its mean
+// and matched against the atlas by hamming distance, cells without enough contrast fall back to lut.
+cv::Mat4b match(const cv::Mat3b& detail, const GlyphLut& lut);
+
+// Glyph whose coverage mask is closest to top/bottom (layout as in GlyphShape).
+char best_glyph(uint64_t top, uint64_t bottom);
+
+}  // namespace glyph_matcher
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LIGHT_MAP_HPP
+#define LIGHT_MAP_HPP
+
+#include <cstdint>
+#include <vector>
+#include <ascii_image.hpp>
+#include <color_utils.hpp>
+
+// A point light, or a flashlight cone when spread is set. Positions and reach are in cells.
+struct Light {
+    cv::Point2f position;
+    float radius = 8;       // reach in columns, rows reach radius / cell aspect
+    float intensity = 1;    // 0 to 1
+    float direction = 0;    // cone axis in radians, 0 points right and pi / 2 down
+    float spread = 0;       // cone half angle in radians, 0 shines all round
+    float flicker = 0;      // deepest dip in intensity, 0 to 1, a new dip every frame
+};
+
+// Light level of every cell of a grid, one byte per cell, from ambient light plus
+// lights whose field of view is shadowcast around occluding cells.
+// Each light keeps its own contribution over its reach. Moving a light shadowcasts
+// that light again; only the rectangles it left and entered are summed again, from
+// the contributions overlapping them. Flicker and intensity changes only sum again.
+// An update costs about the area of the lights that changed, whatever the grid size
+// and however many lights stand still.
+class LightMap {
+public:
+    using LightId = int;
+
+    LightMap();
+    explicit LightMap(cv::Size size);
+
+    // Changes the grid size. Occluders are cleared and every light is cast again.
+    void resize(cv::Size size);
+    cv::Size size() const;
+    // Level of unlit cells, 0 to 255.
+    void set_ambient(uint8_t level);
+    // Terminal cell height over width, so light reaches as far down as across.
+    void set_cell_aspect(float aspect);
+    // Non-zero cells block light. Same size as the grid.
+    void set_occluders(const cv::Mat1b& occluders);
+    void set_occluder(cv::Point cell, bool opaque);
+
+    LightId add_light(const Light& light);
+    void remove_light(LightId id);
+    void set_light(LightId id, const Light& light);
+    const Light& light(LightId id) const;
+    // True without lights, the map is then only ambient.
+    bool empty() const;
+
+    // Works out this frame's flicker and brings the levels up to date.
+    void update(uint64_t frame);
+    // Row major, 255 is full light.
+    const std::vector<uint8_t>& levels() const;
+    // Rectangles the last update summed again, and how many lights it shadowcast.
+    const std::vector<cv::Rect>& updated_rects() const;
+    size_t recast_count() const;
+
+    // Writes source lit by the levels into out: colours scaled by the light and glyphs
+    // picked again from lut by the lit brightness, so dark cells thin out to blanks.
+    // lut should be the table source was converted with. With glyphs off (shape matched
+    // cells) only the colours are scaled. Cells outside the grid keep their colour.
+    // out gets new storage if it's shared or a different size, otherwise it is
+    // overwritten in place.
+    void apply(const AsciiImage& source, const GlyphLut& lut, AsciiImage& out, bool glyphs = true) const;
+
+private:
+    struct Slot {
+        Light light;
+        bool alive = false;
+        bool recast = true;
+        int gain = 0;                 // intensity with flicker, 256 is full
+        cv::Rect area;                // cells the contribution covers
+        std::vector<uint8_t> shape;   // contribution at full intensity, row major over area
+    };
+
+    void cast(Slot& slot) const;
+    void mark(const cv::Rect& rect);
+    void accumulate(const cv::Rect& rect);
+
+    cv::Size size_;
+    std::vector<uint8_t> levels_;
+    std::vector<uint8_t> occluders_;
+    uint8_t ambient_ = 0;
+    float cell_aspect_ = 2.0f;
+    std::vector<Slot> slots_;
+    std::vector<LightId> free_ids_;
+    std::vector<cv::Rect> dirty_;
+    std::vector<cv::Rect> updated_;
+    size_t recasts_ = 0;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+#include <array>
+#include <cstdint>
+
+// Colour depth of the escape codes written for an image.
+enum class PaletteMode {
+    TrueColor,  // ESC[38;2;r;g;bm
+    Ansi256,    // ESC[38;5;nm, xterm colour cube and grey ramp
+    Ansi16,     // ESC[3nm / ESC[9nm
+    Mono        // no colour codes at all
+};
+
+// Escape code of one palette entry, padded so it can be copied with a fixed size.
+struct PaletteCode {
+    char bytes[15];
+    uint8_t length;
+};
+
+// RGB to palette index through a 32x32x32 table built once per mode, so mapping a
+// cell is a single load instead of a nearest colour search.
+class Palette {
+public:
+    // Shared table for mode, built on first use. Not meaningful for TrueColor and Mono.
+    static const Palette& get(PaletteMode mode);
+
+    PaletteMode mode() const { return mode_; }
+    uint8_t index(uint8_t r, uint8_t g, uint8_t b) const {
+        return lut_[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+    }
+    const PaletteCode& code(uint8_t index) const { return codes_[index]; }
+    // Colour the terminal shows for index, assuming the xterm defaults.
+    const std::array<uint8_t, 3>& color(uint8_t index) const { return colors_[index]; }
+
+private:
+    explicit Palette(PaletteMode mode);
+
+    PaletteMode mode_;
+    std::array<uint8_t, 32 * 32 * 32> lut_;
+    std::array<PaletteCode, 256> codes_{};
+    std::array<std::array<uint8_t, 3>, 256> colors_{};
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef PARALLEL_ROWS_HPP
+#define PARALLEL_ROWS_HPP
+
+#include <functional>
+
+// Row band parallelism shared by conversion and encoding.
+namespace parallel_rows {
+
+// Worker threads for row bands and OpenCV's own loops (cv::resize), 0 restores OpenCV's default.
+void set_threads(int threads);
+int threads();
+
+// Number of bands rows is split into, every band gets at least min_rows rows.
+int band_count(int rows, int min_rows);
+
+// Calls body(band, first_row, end_row) for every band, bands run concurrently.
+void run(int rows, int bands, const std::function<void(int, int, int)>& body);
+
+}  // namespace parallel_rows
+
+#endif
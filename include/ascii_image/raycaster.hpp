@@ -0,0 +1,84 @@
+#ifndef RAYCASTER_HPP
+#define RAYCASTER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ascii_image.hpp>
+#include <color_utils.hpp>
+
+// Where the view is from, in map cells. x runs right along a map row, y down the rows.
+struct RayCamera {
+    double x = 1.5;
+    double y = 1.5;
+    double angle = 0;   // radians, 0 looks along +x
+    double fov = 1.15;  // horizontal field of view in radians, about 66 degrees
+};
+
+struct RaySettings {
+    cv::Vec3b ceiling{40, 40, 48};
+    cv::Vec3b floor{96, 84, 72};
+    cv::Vec3b fog{0, 0, 0};
+    float fog_density = 0.12f;   // fog share is 1 - exp(-fog_density * distance)
+    float falloff = 0.15f;       // light is 1 / (1 + falloff * distance)
+    float side_shade = 0.7f;     // walls facing along y, so corners stay readable
+    float cell_aspect = 2.0f;    // terminal cell height over width
+    float max_distance = 64;     // rays that hit nothing by then show fog
+};
+
+// First-person view of a grid map, one DDA ray per cell column (Wolfenstein style).
+// Walls are textured from AsciiImage cells. Depth shading and fog darken a cell's
+// colour, and its glyph is picked from the density ramp by that darkened brightness.
+// Column bands are cast on separate threads. Each column is drawn top to bottom into a
+// transposed grid, reading the texture column the same way, so both stay in cache.
+// The grid is then transposed into the output.
+class Raycaster {
+public:
+    Raycaster();
+
+    // Map rows of equal length. ' ' and '.' are open floor, '1' to '9' are walls with that
+    // texture, anything else is wall 1. Cells past the edge count as open.
+    bool set_map(const std::vector<std::string>& rows);
+    bool has_map() const;
+    cv::Size map_size() const;
+    // Wall texture at x, y, 0 where it is open or off the map.
+    uint8_t tile(int x, int y) const;
+    // Cells of walls with texture, repeated once per wall cell. Walls without one are plain grey.
+    void set_texture(uint8_t texture, const AsciiImage& image);
+    void set_camera(const RayCamera& camera);
+    const RayCamera& camera() const;
+    void set_settings(const RaySettings& settings);
+    const RaySettings& settings() const;
+    // Density ramp, ColorUtils::glyph_lut() until set.
+    void set_lut(const GlyphLut& lut);
+    const GlyphLut& lut() const;
+    // Changes with the map, a texture, the camera, the settings or the lut, so a view that
+    // hasn't changed needn't be drawn again.
+    uint64_t revision() const;
+
+    // Draws the view at size cells into out. out gets new storage if it's shared or a
+    // different size, otherwise it is overwritten in place.
+    void render(cv::Size size, AsciiImage& out) const;
+
+private:
+    // Texels column major, so a wall column reads them in order.
+    struct Texture {
+        int width = 0;
+        int height = 0;
+        std::vector<cv::Vec3b> texels;
+    };
+    struct View;   // worked out once per render
+
+    void draw_column(const View& view, int x, cv::Vec4b* column) const;
+
+    int map_width_ = 0;
+    int map_height_ = 0;
+    std::vector<uint8_t> map_;
+    std::vector<Texture> textures_;   // by texture number, 0 unused
+    RayCamera camera_;
+    RaySettings settings_;
+    GlyphLut lut_;
+    uint64_t revision_ = 0;
+};
+
+#endif
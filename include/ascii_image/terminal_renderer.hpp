@@ -0,0 +1,39 @@
+#ifndef TERMINAL_RENDERER_HPP
+#define TERMINAL_RENDERER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <ascii_image.hpp>
+
+// Draws successive AsciiImages to a terminal file descriptor, rewriting only the
+// runs of cells that changed since the previous frame.
+// Each frame is wrapped in synchronized output markers (DEC mode 2026) and written
+// with a single write call.
+class TerminalRenderer {
+public:
+    explicit TerminalRenderer(int fd = 1);
+    ~TerminalRenderer();
+
+    bool present(const AsciiImage& image);
+    // Forces the next present to redraw every cell, e.g. after the terminal was cleared.
+    void invalidate();
+    // Hides the cursor and clears the screen, restored by the destructor.
+    void begin();
+
+    size_t last_frame_bytes() const;
+
+private:
+    bool flush(const char* data, size_t size);
+
+    int fd_;
+    bool began_ = false;
+    bool valid_ = false;
+    int rows_ = 0;
+    int cols_ = 0;
+    PaletteMode mode_ = PaletteMode::TrueColor;
+    std::vector<uint32_t> previous_;
+    std::vector<char> buffer_;
+    size_t last_frame_bytes_ = 0;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef TONE_MAP_HPP
+#define TONE_MAP_HPP
+
+#include <opencv2/opencv.hpp>
+#include <color_utils.hpp>
+#include <array>
+#include <string>
+#include <string_view>
+
+// Built-in density ramps, densest glyph first like ColorUtils::full_density_range.
+enum class Ramp {
+    Full,   // the 70 glyph ramp with trailing blanks
+    Short,  // ten classic steps, chunkier look
+    Dim,    // only light glyphs, for scenes where the lights are out
+    Custom  // ToneSettings::custom_ramp
+};
+
+struct ToneSettings {
+    int contrast = 10;          // -10 to 10, drops 11 - contrast glyphs from the sparse end as in test.py
+    float gamma = 1.0f;         // > 1 brightens the mid tones
+    Ramp ramp = Ramp::Full;
+    std::string custom_ramp;    // densest first, used with Ramp::Custom
+    bool auto_exposure = false; // stretch the 1st to 99th brightness percentile over the ramp
+    float exposure_smoothing = 0.1f; // share of each new frame in the exposure average, 1 disables smoothing
+};
+
+namespace tone_map {
+
+constexpr int kMinContrast = -10;
+constexpr int kMaxContrast = 10;
+
+inline constexpr std::string_view kRampFull =
+    "$@B%8&WM#*oahkbdpqwmZO0QLCJUYXzcvunxrjft/\\|()1{}[]?-_+~<>i!lI;:,\"^`'.            ";
+inline constexpr std::string_view kRampShort = "@%#*+=-:. ";
+inline constexpr std::string_view kRampDim = ":-~^`'.         ";
+
+// Brightness to glyph for ramp truncated by contrast, bright pixels take the dense end.
+// At least two glyphs are kept, a one glyph ramp fills the table with that glyph.
+constexpr GlyphLut make_ramp_lut(std::string_view ramp, int contrast) {
+    GlyphLut lut{};
+    const int size = static_cast<int>(ramp.size());
+    if (size == 0) {
+        return lut;
+    }
+    const int kept = size - (11 - contrast);
+    const int n = kept >= 2 ? kept : (size < 2 ? size : 2);
+    for (int brightness = 0; brightness < 256; ++brightness) {
+        lut[brightness] = ramp[n - 1 - brightness * n / 256];
+    }
+    return lut;
+}
+
+constexpr std::array<GlyphLut, kMaxContrast - kMinContrast + 1> make_contrast_luts(std::string_view ramp) {
+    std::array<GlyphLut, kMaxContrast - kMinContrast + 1> luts{};
+    for (int contrast = kMinContrast; contrast <= kMaxContrast; ++contrast) {
+        luts[contrast - kMinContrast] = make_ramp_lut(ramp, contrast);
+    }
+    return luts;
+}
+
+// Every built-in ramp at every contrast, evaluated by the compiler.
+inline constexpr std::array<std::array<GlyphLut, kMaxContrast - kMinContrast + 1>, 3> kRampLuts = {
+    make_contrast_luts(kRampFull),
+    make_contrast_luts(kRampShort),
+    make_contrast_luts(kRampDim),
+};
+
+// Ramp table for settings, custom ramps are built once and cached.
+const GlyphLut& ramp_lut(const ToneSettings& settings);
+
+}  // namespace tone_map
+
+// Folds contrast, gamma, ramp and exposure into a single brightness to glyph table.
+// The table is only rebuilt when the settings or the exposure change, converting
+// pixels never looks at the settings.
+class ToneMapper {
+public:
+    ToneMapper();
+
+    void set_settings(const ToneSettings& settings);
+    const ToneSettings& settings() const;
+    const GlyphLut& lut() const;
+
+    // Auto exposure: measures an RGB frame and moves the black and white points towards it.
+    // Does nothing while auto_exposure is off.
+    void observe(const cv::Mat3b& rgb);
+    // Jumps straight to the next observed frame's exposure, e.g. on a scene cut.
+    void reset_exposure();
+
+private:
+    void rebuild();
+
+    ToneSettings settings_;
+    GlyphLut lut_{};
+    float black_ = 0;
+    float white_ = 255;
+    bool exposed_ = false;  // black_/white_ come from a frame
+    int built_black_ = -1;  // points the table was built for
+    int built_white_ = -1;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef ANSI_BLOCK_HPP
+#define ANSI_BLOCK_HPP
+
+#include "ftxui/dom/node.hpp"                      // for Node
+#include "ftxui/dom/elements.hpp"                  // for Element
+#include "ftxui/screen/screen.hpp"                 // for Screen
+#include "ftxui/dom/selection.hpp"                 // for Selection
+#include "ftxui/screen/box.hpp"                    // for Box
+#include <ansi_text.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ftxui {
+
+enum class AnsiAlign {
+    Left,
+    Right,
+    Center,
+    Justify   // spaces widened to fill the width, the last row of each line stays left
+};
+
+// One row on screen, a range of glyphs of the document.
+struct AnsiRow {
+    size_t begin = 0;
+    size_t end = 0;
+    bool last = true;   // last row of its line, never justified
+};
+
+// Multi-line ANSI text parsed once: glyphs, the style each one is drawn with (an
+// index in the document's style table, 0 is plain) and where the lines start. Colour carries over spaces and
+// line ends like it does in a terminal.
+// Documents are cached per thread by their text, so an element rebuilt every frame
+// from the same string doesn't parse it again. A document never changes once parsed,
+// blocks sharing it keep their own wraps.
+class AnsiDocument {
+public:
+    explicit AnsiDocument(const std::string& text);
+
+    // Cached document for text, parsed on a miss.
+    static std::shared_ptr<AnsiDocument> Get(const std::string& text);
+
+    const std::string& text() const;
+    const std::vector<std::string>& glyphs() const;
+    const std::vector<uint32_t>& styles() const;
+    const std::vector<AnsiStyle>& style_table() const;
+
+    // Rows for width into rows, breaking lines at the last space that fits and splitting
+    // words longer than width. width <= 0 doesn't wrap. Returns the widest row.
+    int Wrap(int width, std::vector<AnsiRow>& rows) const;
+
+private:
+    std::string text_;
+    std::vector<std::string> glyphs_;
+    std::vector<uint32_t> styles_;
+    std::vector<AnsiStyle> style_table_;
+    std::vector<size_t> line_starts_;   // plus the end of the last line
+};
+
+// The whole text as one node, however many lines and words it has.
+// Layout and drawing only visit the rows and cells inside the box.
+class AnsiBlock : public Node {
+public:
+    AnsiBlock(std::shared_ptr<const AnsiDocument> document, AnsiAlign align);
+
+    void ComputeRequirement() override;
+    void SetBox(Box box) override;
+    void Check(Status* status) override;
+    void Select(Selection& selection) override;
+    void Render(Screen& screen) override;
+private:
+    // Screen column of every glyph of row, relative to the box.
+    template <typename F>
+    void ForEachCell(const AnsiRow& row, F&& f) const;
+    // Rows for width, wrapped again only when width changes.
+    const std::vector<AnsiRow>& Rows(int width);
+
+    std::shared_ptr<const AnsiDocument> document_;
+    AnsiAlign align_;
+    std::vector<AnsiRow> rows_;
+    int wrapped_width_ = -1;
+    int wrapped_columns_ = 0;
+    bool need_iteration_ = false;
+    bool has_selection_ = false;
+    std::vector<Box> selection_;   // per visible row, x range only
+};
+
+// Multi-line ANSI text in a single node, wrapped to the box and aligned.
+Element ansi_block(const std::string& text, AnsiAlign align = AnsiAlign::Left);
+
+}  // namespace ftxui
+
+#endif
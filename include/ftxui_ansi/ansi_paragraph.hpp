@@ -1,96 +1,50 @@
 #ifndef ANSI_PARAGRAPH_HPP
 #define ANSI_PARAGRAPH_HPP
-#include <functional>  // for function
-#include <sstream>     // for basic_istream, stringstream
-#include <string>      // for string, allocator, getline
-#include <utility>     // for move
-#include <ansi_text.hpp>
-#include "ftxui/dom/elements.hpp"  // for flexbox, Element, text, Elements, operator|, xflex, paragraph, paragraphAlignCenter, paragraphAlignJustify, paragraphAlignLeft, paragraphAlignRight
-#include "ftxui/dom/flexbox_config.hpp"  // for FlexboxConfig, FlexboxConfig::JustifyContent, FlexboxConfig::JustifyContent::Center, FlexboxConfig::JustifyContent::FlexEnd, FlexboxConfig::JustifyContent::SpaceBetween
+#include <string>      // for string
+#include <ansi_block.hpp>
+#include "ftxui/dom/elements.hpp"  // for Element
 
 namespace ftxui {
 
-namespace {
-Elements AnsiSplit(const std::string& the_text) {
-  Elements output;
-  std::stringstream ss(the_text);
-  std::string word;
-  while (std::getline(ss, word, ' ')) {
-    output.push_back(ansi_text(word));
-  }
-  return output;
-}
-
-Element AnsiSplit(const std::string& paragraph,
-              const std::function<Element(std::string)>& f) {
-  Elements output;
-  std::stringstream ss(paragraph);
-  std::string line;
-  while (std::getline(ss, line, '\n')) {
-    output.push_back(f(line));
-  }
-  return vbox(std::move(output));
-}
-
-}  // namespace
-
 /// @brief Return an element drawing the paragraph on multiple lines.
 /// @ingroup dom
-/// @see flexbox.
+/// @see ansi_block.
 inline Element ansi_paragraph(const std::string& the_text) {
-  return ansiParagraphAlignLeft(the_text);
+  return ansi_block(the_text, AnsiAlign::Left);
 }
 
 /// @brief Return an element drawing the paragraph on multiple lines, aligned on
 /// the left.
 /// @ingroup dom
-/// @see flexbox.
+/// @see ansi_block.
 inline Element ansiParagraphAlignLeft(const std::string& the_text) {
-  return AnsiSplit(the_text, [](const std::string& line) {
-    static const auto config = FlexboxConfig().SetGap(1, 0);
-    return flexbox(AnsiSplit(line), config);
-  });
+  return ansi_block(the_text, AnsiAlign::Left);
 }
 
 /// @brief Return an element drawing the paragraph on multiple lines, aligned on
 /// the right.
 /// @ingroup dom
-/// @see flexbox.
+/// @see ansi_block.
 inline Element ansiParagraphAlignRight(const std::string& the_text) {
-  return AnsiSplit(the_text, [](const std::string& line) {
-    static const auto config = FlexboxConfig().SetGap(1, 0).Set(
-        FlexboxConfig::JustifyContent::FlexEnd);
-    return flexbox(AnsiSplit(line), config);
-  });
+  return ansi_block(the_text, AnsiAlign::Right);
 }
 
 /// @brief Return an element drawing the paragraph on multiple lines, aligned on
 /// the center.
 /// @ingroup dom
-/// @see flexbox.
+/// @see ansi_block.
 inline Element ansiParagraphAlignCenter(const std::string& the_text) {
-  return AnsiSplit(the_text, [](const std::string& line) {
-    static const auto config =
-        FlexboxConfig().SetGap(1, 0).Set(FlexboxConfig::JustifyContent::Center);
-    return flexbox(AnsiSplit(line), config);
-  });
+  return ansi_block(the_text, AnsiAlign::Center);
 }
 
 /// @brief Return an element drawing the paragraph on multiple lines, aligned
 /// using a justified alignment.
-/// the center.
 /// @ingroup dom
-/// @see flexbox.
+/// @see ansi_block.
 inline Element ansiParagraphAlignJustify(const std::string& the_text) {
-  return AnsiSplit(the_text, [](const std::string& line) {
-    static const auto config = FlexboxConfig().SetGap(1, 0).Set(
-        FlexboxConfig::JustifyContent::SpaceBetween);
-    Elements words = AnsiSplit(line);
-    words.push_back(ansi_text("") | xflex);
-    return flexbox(std::move(words), config);
-  });
+  return ansi_block(the_text, AnsiAlign::Justify);
 }
 
 }  // namespace ftxui
 
-#endif
\ No newline at end of file
+#endif
@@ -7,6 +7,9 @@
 #include "ftxui/dom/selection.hpp"                 // for Selection
 #include "ftxui/screen/box.hpp"                    // for Box
 #include "ftxui/screen/string.hpp"                 // for Utf8ToGlyphs, string_width
+#include "ftxui/screen/color.hpp"                  // for Color
+#include "ftxui/screen/pixel.hpp"                  // for Pixel
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -15,12 +18,47 @@
 
 namespace ftxui {
 
+// Colours and attributes the SGR codes before a glyph left set. Only what they set is
+// applied to a pixel, so decorators around the element still show elsewhere.
+struct AnsiStyle {
+    Color foreground;
+    Color background;
+    bool has_foreground = false;
+    bool has_background = false;
+    bool bold = false;
+    bool dim = false;
+    bool italic = false;
+    bool underlined = false;
+    bool underlined_double = false;
+    bool blink = false;
+    bool inverted = false;
+    bool strikethrough = false;
+};
+
+// Copies what style sets onto pixel, without allocating.
+void ApplyStyle(const AnsiStyle& style, Pixel& pixel);
+
 // Structure to hold parsed ANSI text with color information
 struct AnsiSegment {
     std::string text;
-    std::string ansi_code;  // The ANSI escape sequence
+    uint32_t style = 0;     // index in AnsiParseResult::styles
+    size_t glyph_begin = 0; // range of this segment in AnsiParseResult::glyphs
+    size_t glyph_end = 0;
 };
 
+// Everything a single scan over an ANSI string produces
+struct AnsiParseResult {
+    std::vector<AnsiSegment> segments;
+    std::vector<AnsiStyle> styles;   // each distinct style once, styles[0] is plain
+    std::vector<std::string> glyphs; // visible glyphs, escape codes and newlines removed
+    std::vector<size_t> line_starts; // index in glyphs where each line begins, the first is 0
+    int visible_width = 0;
+};
+
+// Tokenizes text in one pass. SGR sequences (CSI ... m) update the style of the
+// following segments like a terminal would; other CSI, OSC and two byte escapes are dropped.
+AnsiParseResult ParseAnsi(const std::string& text);
+
 class AnsiText : public Node {
 public:
     explicit AnsiText(std::string text);
@@ -29,13 +67,8 @@ public:
     void Select(Selection& selection) override;
     void Render(Screen& screen) override;
 private:
-    void ParseAnsiText();
-    static int CalculateVisibleWidth(const std::string& text);// Calculate visible width (excluding ANSI escape codes
-    static std::string StripAnsiCodes(const std::string& text);// Strip ANSI codes from text
-
     std::string text_;
-    std::vector<AnsiSegment> segments_;
-    int visible_width_;
+    AnsiParseResult parsed_;
     bool has_selection = false;
     int selection_start_ = 0;
     int selection_end_ = -1;
@@ -48,4 +81,4 @@ Element ansi_text(std::string text);
 
 }  // namespace ftxui
 
-#endif
\ No newline at end of file
+#endif
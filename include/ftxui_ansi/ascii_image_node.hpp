@@ -0,0 +1,28 @@
+#ifndef ASCII_IMAGE_NODE_HPP
+#define ASCII_IMAGE_NODE_HPP
+
+#include "ftxui/dom/node.hpp"                      // for Node
+#include "ftxui/dom/elements.hpp"                  // for Element
+#include "ftxui/screen/screen.hpp"                 // for Screen
+#include <ascii_image.hpp>
+
+namespace ftxui {
+
+// Draws the cells of an AsciiImage directly: one glyph per pixel, coloured
+// through Pixel::foreground_color instead of embedded escape codes.
+class AsciiImageNode : public Node {
+public:
+    explicit AsciiImageNode(AsciiImage image);
+
+    void ComputeRequirement() override;
+    void Render(Screen& screen) override;
+private:
+    AsciiImage image_;
+};
+
+// Factory function to create an element from an AsciiImage
+Element ascii_image(AsciiImage image);
+
+}  // namespace ftxui
+
+#endif
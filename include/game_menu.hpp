@@ -1,17 +1,52 @@
 #ifndef GAME_MENU_HPP
 #define GAME_MENU_HPP
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 #include "ftxui/component/captured_mouse.hpp"      // for ftxui
 #include "ftxui/component/component.hpp"           // for Menu
 #include "ftxui/component/component_options.hpp"   // for MenuOption
 #include "ftxui/component/screen_interactive.hpp"  // for ScreenInteractive
 #include "ftxui/dom/elements.hpp"                  // for color, bgcolor, etc.
 #include <ascii_generator.hpp>
+#include <ascii_video.hpp>
 #include <ansi_paragraph.hpp>
 #include "ansi_text.hpp"
+#include "ascii_image_node.hpp"
+#include "triple_buffer.hpp"
+#include "frame_trace.hpp"
+#include "compositor.hpp"
+#include "effect_chain.hpp"
+#include "raycaster.hpp"
+#include "light_map.hpp"
 using namespace ftxui;
 
 
+// Everything the HUD panels show, built by the worker thread and handed to the UI as a whole.
+struct HudFrame{
+std::string inventory_text = "inventory\n- items";
+std::string screen_text = "screen\n- images";
+AsciiImage screen_image = AsciiImage(AsciiImageData()); // drawn instead of screen_text once set
+std::string action_text = "action\n- menu";
+std::string stats_text; // stats panel contents, only kept up to date while it is shown
+cv::Size screen_size; // panel size screen_image was made for
+};
+
+// Panel boxes as last laid out by the UI thread.
+struct HudLayout{
+Box inventory_box;
+Box screen_box;
+Box action_box;
+};
 
 struct MenuStructure{
 
@@ -20,18 +55,48 @@ public:
         return(top_level);
     }    MenuStructure():
     inventory_renderer(Renderer([this] { 
-        return ansi_paragraph(inventory_text) | reflect(inventory_box); 
+        return ansi_paragraph(frame->inventory_text) | reflect(inventory_box); 
     })),
     screen_renderer( Renderer([this] { 
-        return ansi_paragraph(screen_text) | reflect(screen_box); 
+        if (frame->screen_image.get_cells().empty()) {
+            return ansi_paragraph(frame->screen_text) | reflect(screen_box);
+        }
+        return ascii_image(frame->screen_image) | reflect(screen_box);
     })),
     action_renderer(Renderer([this] { 
-        return ansi_paragraph(action_text) | reflect(action_box); 
+        return ansi_paragraph(frame->action_text) | reflect(action_box); 
     }))
     {
     top_level = screen_renderer;
     top_level = ResizableSplitLeft(action_renderer,top_level,&left_size);
     top_level = ResizableSplitBottom(inventory_renderer,top_level,&bottom_size);
+
+    // F2 shows per-stage frame timings over the panels, tracing only runs while it is shown.
+    Component panels = top_level;
+    top_level = Renderer(panels, [this, panels] {
+        Element base = panels->Render();
+        if (!show_stats) {
+            return base;
+        }
+        Elements lines;
+        std::stringstream stats(frame->stats_text);
+        for (std::string line; std::getline(stats, line);) {
+            lines.push_back(text(line));
+        }
+        return dbox({base, hbox({filler(), vbox(std::move(lines)) | border | clear_under})});
+    });
+    top_level = CatchEvent(top_level, [this](Event event) {
+        if (event != Event::F2) {
+            return false;
+        }
+        show_stats = !show_stats;
+        frame_trace::set_enabled(show_stats);
+        return true;
+    });
+    }
+    // UI thread: picks up the newest published frame, call once before rendering.
+    void latch(){
+        frame = &frames.read();
     }
 public:
     Component inventory_renderer;
@@ -42,32 +107,212 @@ public:
     Box action_box;
     Component top_level;
 public:
-std::string inventory_text = "inventory\n- items";
-std::string screen_text = "screen\n- images";
-std::string action_text = "action\n- menu";
+TripleBuffer<HudFrame> frames;            // worker -> UI
+const HudFrame* frame = &frames.read();   // frame being drawn, UI thread only
 int left_size = 20;
 int bottom_size = 10;
+std::atomic<bool> show_stats{false};      // toggled by the UI, read by the worker
+
+
+};
+
+// Scheduler settings for DisplayHUD.
+struct HudTiming{
+double target_fps = 30;                           // screen frames per second
+double tick_rate = 60;                            // fixed simulation steps per second
+int max_ticks_per_frame = 5;                      // backlog beyond this is dropped instead of spiralling
+std::chrono::milliseconds resize_debounce{50};    // panel size must hold this long before regenerating
+std::chrono::milliseconds still_refresh{1000};    // re-check the still image (cheap on cache hits)
+};
+
+// Last samples of a timing in milliseconds, for percentile queries.
+class SampleRing{
+public:
+    void add(double ms);
+    double percentile(double p) const;
+    size_t count() const;
+private:
+    std::array<double, 512> samples{};
+    size_t next = 0;
+    size_t filled = 0;
+};
 
+// Output grids for a worker stage, taken in turn. The grid last published stays with the
+// UI while the next frame is drawn into one it has let go of, so it is written in place.
+class GridRing{
+public:
+    // Grid to draw the next frame into, it becomes latest().
+    AsciiImage& next();
+    const AsciiImage& latest() const;
+private:
+    std::array<AsciiImage, 3> grids{AsciiImage(AsciiImageData()), AsciiImage(AsciiImageData()), AsciiImage(AsciiImageData())};
+    size_t current = 0;
+};
+
+struct HudStats{
+double frame_time_p50_ms = 0;      // time to build a frame on the worker
+double frame_time_p99_ms = 0;
+double frame_interval_p50_ms = 0;  // time between scheduled frames
+double frame_interval_p99_ms = 0;
+double input_latency_p50_ms = 0;   // input event to the frame drawn after it
+double input_latency_p99_ms = 0;
+double resize_latency_p50_ms = 0;  // panel resize to the first frame at the new size
+double resize_latency_p99_ms = 0;
+size_t frames = 0;
+size_t ticks = 0;
+size_t skipped_ticks = 0;
+size_t skipped_frames = 0;
+size_t conversions = 0;
+size_t cancelled_conversions = 0;
+size_t failed_conversions = 0;    // the still couldn't be read
+};
 
+// One step of a headless run's script, applied before its frame is rendered.
+struct HeadlessStep{
+int frame = 0;
+std::optional<Event> event;        // delivered to the component tree like a key press
+std::optional<cv::Size> resize;    // new offscreen size in cells
+};
+
+struct HeadlessOptions{
+cv::Size size{160, 48};                             // offscreen size in cells
+int frames = 600;                                   // rendered back to back, no frame pacing
+std::vector<HeadlessStep> script;
+std::vector<int> dump_frames;                       // written as plain text for golden comparison
+std::string dump_prefix = "hud_frame_";             // dumps go to <prefix><frame>.txt
+std::chrono::milliseconds settle_timeout{2000};     // longest a dumped frame waits for the worker
+};
+
+struct HeadlessReport{
+int frames = 0;
+double seconds = 0;
+double fps = 0;
+double render_p50_ms = 0;   // layout, draw and terminal string for one frame
+double render_p99_ms = 0;
+size_t bytes = 0;           // terminal output the frames would have written
+std::vector<std::string> dumps;
 };
 
 class DisplayHUD{
 public:
+    using Clock = std::chrono::steady_clock;
+
     DisplayHUD();
+    ~DisplayHUD();
 
 
     void loop();
+    // Drives the same component tree against an offscreen Screen instead of the terminal,
+    // so frame throughput can be measured and frames compared without a TTY.
+    // The worker and converter threads run as in loop(). Call instead of loop(), not after it.
+    HeadlessReport runHeadless(const HeadlessOptions& options);
     Element render();
     void updateScreen();
+    // Shows a video or image sequence in the screen panel until it ends, call before loop().
+    void play(const std::string& source, double fps = 0);
+    // Call before loop().
+    void setTiming(const HudTiming& timing);
+    // Called on the worker thread once per fixed simulation step with the step length in seconds.
+    void setTickHandler(std::function<void(double)> handler);
+    // Mood of the screen panel, e.g. a dimmer ramp when the lights go out. Safe to call any time.
+    void setTone(const ToneSettings& settings);
+    // Brightness picked glyphs or shape matched ones for the still and video. Safe to call any time.
+    void setGlyphMode(GlyphMode mode);
+    HudStats stats() const;
+    // Writes the stage timings recorded so far as Chrome trace-event JSON, also bound to F3.
+    bool exportTrace(const std::string& path) const;
+    // Sprites and overlays drawn over the screen panel image, in its cell coordinates.
+    // The image itself is the lowest layer. Worker thread only, e.g. from the tick handler.
+    Compositor& scene();
+    // Post-processing run over the composited screen panel every frame while not empty.
+    // Worker thread only, like scene().
+    EffectChain& effects();
+    // First-person view drawn into the screen panel at its live size instead of the still,
+    // once it has a map. Worker thread only after loop() starts, e.g. move the camera from
+    // the tick handler.
+    Raycaster& view();
+    // Lights and occluders over the screen panel, in its cell coordinates. Applied to the
+    // composited image before the effects while it has lights, and resized with the panel
+    // (which clears its occluders). Worker thread only, like scene().
+    LightMap& lighting();
 
 
 private:
+    struct ConversionRequest{
+        cv::Size size;
+        uint64_t generation;
+    };
+    struct ConversionResult{
+        uint64_t generation;
+        AsciiImage image;
+        GlyphLut lut;
+        bool shape_glyphs;
+    };
+
+    cv::Size screenImageSize(const HudLayout& layout) const;
+    std::string statsText() const;
+    void publish(const HudFrame& frame);
+    void start();
+    // Headless only: renders until the worker has published a frame made for the panel's size.
+    void settle(Screen& offscreen, Clock::duration timeout);
+    // lut and shape_glyphs say how image's glyphs were picked, so lighting can pick them the same way.
+    void setBackground(const AsciiImage& image, const GlyphLut& lut, bool shape_glyphs);
+    void stop();
+    // Worker side sleep that returns early when the HUD shuts down or a conversion finishes.
+    bool waitUntil(Clock::time_point deadline);
+    void requestConversion(cv::Size size);
+    void convertLoop();
 
     MenuStructure menu;
     ScreenInteractive screen;
     Component top_level_component;
     Component renderer;
     AsciiGenerator generator;
+    AsciiVideoSource video;
+    std::string still_path = "images/boat.jpg";
+    HudTiming timing;
+    std::function<void(double)> tick_handler;
+    Compositor compositor;
+    Compositor::LayerId background_layer;
+    bool background_greyscale = false;
+    GlyphLut background_lut = ColorUtils::glyph_lut();
+    bool background_shape = false;
+    EffectChain effect_chain;
+    GridRing effect_outputs;
+    Raycaster raycaster;
+    AsciiImage raycast_output = AsciiImage(AsciiImageData());
+    LightMap light_map;
+    GridRing lit_outputs;
+
+    TripleBuffer<HudLayout> layouts;   // UI -> worker
+    std::thread worker;
+    std::atomic<bool> running{false};
+    bool headless = false;   // set before the threads start, no terminal to wake
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+
+    // Still image conversion runs on its own thread so resizes can cancel it.
+    std::thread converter;
+    std::mutex convert_mutex;
+    std::condition_variable convert_wake;
+    std::optional<ConversionRequest> convert_request;
+    std::optional<ConversionResult> convert_result;
+    std::atomic<uint64_t> convert_generation{0};
+    std::atomic<bool> convert_ready{false};
+    std::atomic<bool> tone_changed{false};
+    std::atomic<GlyphMode> glyph_mode{GlyphMode::Brightness};
+
+    // Timing measurements, written by both threads.
+    mutable std::mutex stats_mutex;
+    HudStats counters;
+    SampleRing frame_times;
+    SampleRing frame_intervals;
+    SampleRing input_latencies;
+    SampleRing resize_latencies;
+    // UI thread only
+    std::optional<Clock::time_point> pending_input;
+    std::optional<Clock::time_point> pending_resize;
+    Box last_screen_box;
     
     // Size variables for resizable splits (must be class members)
 
@@ -76,4 +321,4 @@ private:
 
 
 
-#endif
\ No newline at end of file
+#endif
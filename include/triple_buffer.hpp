@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer handoff of the latest value.
+// The writer fills back() and publishes it, the reader picks up whatever was
+// published last. Neither side ever waits for the other, intermediate values
+// the reader never saw are simply overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    explicit TripleBuffer(const T& initial) : buffers_{initial, initial, initial} {}
+
+    // Writer side.
+    T& back() {
+        return buffers_[back_];
+    }
+
+    void publish() {
+        const uint8_t previous = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+        back_ = previous & kIndexMask;
+    }
+
+    // Reader side. The reference stays valid until the next read().
+    const T& read() {
+        if (middle_.load(std::memory_order_relaxed) & kFresh) {
+            const uint8_t previous = middle_.exchange(front_, std::memory_order_acq_rel);
+            front_ = previous & kIndexMask;
+        }
+        return buffers_[front_];
+    }
+
+    bool has_update() const {
+        return middle_.load(std::memory_order_relaxed) & kFresh;
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFresh = 0x4;
+
+    T buffers_[3];
+    std::atomic<uint8_t> middle_{1};
+    uint8_t back_ = 0;   // only touched by the writer
+    uint8_t front_ = 2;  // only touched by the reader
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "baked_asset.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'A', 'C', 'G', 'F'};
+constexpr uint64_t kPlaneAlignment = 64;
+
+uint64_t align_up(uint64_t value) {
+    return (value + kPlaneAlignment - 1) / kPlaneAlignment * kPlaneAlignment;
+}
+
+}  // namespace
+
+std::shared_ptr<BakedAsset> BakedAsset::open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BakedHeader)) {
+        ::close(fd);
+        return nullptr;
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::shared_ptr<BakedAsset> asset(new BakedAsset());
+    asset->mapping_ = mapping;
+    asset->mapping_size_ = size;
+
+    uint8_t* base = static_cast<uint8_t*>(mapping);
+    BakedHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kBakedVersion) {
+        std::cerr << "Error: " << path << " is not a baked asset of version " << kBakedVersion << std::endl;
+        return nullptr;
+    }
+    const size_t table_end = sizeof(BakedHeader) + header.level_count * sizeof(BakedLevelEntry);
+    if (table_end > size) {
+        return nullptr;
+    }
+    asset->flags_ = header.flags;
+    for (uint16_t i = 0; i < header.level_count; ++i) {
+        BakedLevelEntry entry;
+        std::memcpy(&entry, base + sizeof(BakedHeader) + i * sizeof(BakedLevelEntry), sizeof(entry));
+        const uint64_t bytes = uint64_t(entry.width) * entry.height * 4;
+        if (entry.offset < table_end || entry.offset > size || bytes > size - entry.offset) {
+            std::cerr << "Error: " << path << " has a truncated level" << std::endl;
+            return nullptr;
+        }
+        asset->levels_.push_back(BakedLevel{static_cast<int>(entry.width), static_cast<int>(entry.height), base + entry.offset});
+    }
+    return asset;
+}
+
+bool BakedAsset::write(const std::string& path, const std::vector<BakedLevel>& levels, uint32_t flags) {
+    // Written beside the target and renamed over it, so readers mapping the old file keep
+    // their cells and a failed write leaves the old asset in place.
+    const std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error: Could not write " << temp_path << std::endl;
+        return false;
+    }
+
+    BakedHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kBakedVersion;
+    header.level_count = static_cast<uint16_t>(levels.size());
+    header.flags = flags;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    uint64_t offset = align_up(sizeof(BakedHeader) + levels.size() * sizeof(BakedLevelEntry));
+    for (const BakedLevel& level : levels) {
+        BakedLevelEntry entry{static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), offset};
+        out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        offset = align_up(offset + uint64_t(level.width) * level.height * 4);
+    }
+
+    const char padding[kPlaneAlignment] = {};
+    for (const BakedLevel& level : levels) {
+        out.write(padding, align_up(out.tellp()) - out.tellp());
+        out.write(reinterpret_cast<const char*>(level.cells), std::streamsize(level.width) * level.height * 4);
+    }
+    out.close();
+    if (!out || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+BakedAsset::~BakedAsset() {
+    if (mapping_) {
+        ::munmap(mapping_, mapping_size_);
+    }
+}
+
+uint32_t BakedAsset::flags() const {
+    return flags_;
+}
+
+bool BakedAsset::greyscale() const {
+    return flags_ & kBakedGreyscale;
+}
+
+const std::vector<BakedLevel>& BakedAsset::levels() const {
+    return levels_;
+}
+
+const BakedLevel* BakedAsset::find(int width, int height) const {
+    for (const BakedLevel& level : levels_) {
+        if (level.width == width && level.height == height) {
+            return &level;
+        }
+    }
+    return nullptr;
+}
+
+const BakedLevel* BakedAsset::fit(int width, int height) const {
+    const BakedLevel* best = nullptr;
+    for (const BakedLevel& level : levels_) {
+        if (level.width <= width && level.height <= height &&
+            (!best || level.width * level.height > best->width * best->height)) {
+            best = &level;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,116 @@
+#include "ascii_generator.hpp"
+#include "baked_asset.hpp"
+#include "parallel_rows.hpp"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Bakes every image in a directory into an <image>.acg next to it, one level per requested width.
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " <image_dir> [widths] [--greyscale] [--shape] [--threads n]" << std::endl;
+    std::cout << "  image_dir:   Directory with the images to bake, .acg files are written next to them" << std::endl;
+    std::cout << "  widths:      Comma separated cell widths to bake (default: 60,90,120,180,240)" << std::endl;
+    std::cout << "  --greyscale: Mark the baked assets as greyscale" << std::endl;
+    std::cout << "  --shape:     Pick glyphs by outline instead of brightness" << std::endl;
+    std::cout << "  --threads:   Worker threads for conversion (default: all cores)" << std::endl;
+}
+
+bool is_image(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    for (char& c : ext) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" || ext == ".webp";
+}
+
+bool bake(const std::filesystem::path& image_path, const std::vector<int>& widths, bool greyscale, GlyphMode mode) {
+    const cv::Mat source = cv::imread(image_path.string());
+    if (source.empty()) {
+        std::cerr << "Error: Could not load image " << image_path << std::endl;
+        return false;
+    }
+
+    // Keep the source aspect ratio, a cell is about twice as tall as it is wide.
+    AsciiGenerator generator;
+    generator.set_glyph_mode(mode);
+    // The levels must come from the image, not from the .acg about to be replaced.
+    generator.set_use_baked(false);
+    std::vector<AsciiImage> images;
+    std::vector<BakedLevel> levels;
+    for (int columns : widths) {
+        const int width = std::max(1, cvRound(columns / AsciiImage::default_horizontal_scale));
+        const int height = std::max(1, cvRound(columns * source.rows / (2.0 * source.cols)));
+        images.push_back(generator.generate_ascii_from_file(image_path.string(), width, height, greyscale));
+    }
+    for (const AsciiImage& image : images) {
+        const cv::Mat4b& cells = image.get_cells();
+        if (cells.empty() || !cells.isContinuous()) {
+            std::cerr << "Error: Could not convert " << image_path << std::endl;
+            return false;
+        }
+        levels.push_back(BakedLevel{cells.cols, cells.rows, const_cast<uint8_t*>(cells.ptr<uint8_t>())});
+    }
+
+    std::filesystem::path baked_path = image_path;
+    baked_path.replace_extension(".acg");
+    const uint32_t flags = (greyscale ? kBakedGreyscale : 0) | (mode == GlyphMode::Shape ? kBakedShapeGlyphs : 0);
+    if (!BakedAsset::write(baked_path.string(), levels, flags)) {
+        return false;
+    }
+    std::cout << image_path.string() << " -> " << baked_path.string() << " (" << levels.size() << " levels)" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<int> widths = {60, 90, 120, 180, 240};
+    bool greyscale = false;
+    GlyphMode mode = GlyphMode::Brightness;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        try {
+            if (arg == "--greyscale") {
+                greyscale = true;
+            }
+            else if (arg == "--shape") {
+                mode = GlyphMode::Shape;
+            }
+            else if (arg == "--threads" && i + 1 < argc) {
+                parallel_rows::set_threads(std::stoi(argv[++i]));
+            }
+            else {
+                widths.clear();
+                std::stringstream list(arg);
+                std::string item;
+                while (std::getline(list, item, ',')) {
+                    widths.push_back(std::stoi(item));
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: Invalid argument " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::directory_iterator entries(argv[1], ec);
+    if (ec) {
+        std::cerr << "Error: Could not open directory " << argv[1] << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    for (const auto& entry : entries) {
+        if (entry.is_regular_file() && is_image(entry.path()) && !bake(entry.path(), widths, greyscale, mode)) {
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include "ansi_serializer.hpp"
+#include "ascii_image.hpp"
+#include "ansi_encoding.hpp"
+#include "parallel_rows.hpp"
+#include <cerrno>
+#include <unistd.h>
+
+using namespace ansi_encoding;
+
+namespace {
+
+// Bands smaller than this aren't worth a thread.
+constexpr int kMinBandRows = 32;
+
+// Encodes rows [first_row, end_row) into out, returns the new end.
+// palette is null for truecolor output.
+char* encode_rows(const cv::Mat4b& cells, int first_row, int end_row, bool color, const Palette* palette, bool last, char* out) {
+    // Each band starts without a known colour so bands can be encoded independently.
+    long previous = -1;
+    for (int y = first_row; y < end_row; ++y) {
+        const uchar* cell = cells.ptr<uchar>(y);
+        for (int x = 0; x < cells.cols; ++x, cell += 4) {
+            if (color && palette) {
+                // Quantized neighbours often share an index, which saves the code entirely.
+                const uint8_t index = palette->index(cell[0], cell[1], cell[2]);
+                if (index != previous) {
+                    out = put_code(out, palette->code(index));
+                    previous = index;
+                }
+            }
+            else if (color) {
+                const long rgb = (long(cell[0]) << 16) | (long(cell[1]) << 8) | cell[2];
+                if (rgb != previous) {
+                    out = put_rgb(out, cell[0], cell[1], cell[2]);
+                    previous = rgb;
+                }
+            }
+            *out++ = static_cast<char>(cell[3]);
+        }
+        *out++ = '\n';
+    }
+    if (last && color && cells.rows > 0) {
+        out = put_reset(out);
+    }
+    return out;
+}
+
+}  // namespace
+
+AnsiSerializer::AnsiSerializer() {
+}
+
+void AnsiSerializer::encode(const AsciiImage& image) {
+    const cv::Mat4b& cells = image.get_cells();
+    const bool color = image.has_color();
+    const Palette* palette = image.get_palette() == PaletteMode::TrueColor ? nullptr : &Palette::get(image.get_palette());
+    const int bands = parallel_rows::band_count(cells.rows, kMinBandRows);
+
+    if (static_cast<int>(bands_.size()) < bands) {
+        bands_.resize(bands);
+    }
+    segments_.resize(bands);
+    parallel_rows::run(cells.rows, bands, [&](int band, int first_row, int end_row) {
+        // Buffers only grow, so steady state frames of the same size don't allocate.
+        std::vector<char>& buffer = bands_[band];
+        const size_t worst_case = static_cast<size_t>(end_row - first_row) * (cells.cols * kMaxCellBytes + 1) + 4;
+        if (buffer.size() < worst_case) {
+            buffer.resize(worst_case);
+        }
+        char* end = encode_rows(cells, first_row, end_row, color, palette, band == bands - 1, buffer.data());
+        segments_[band].iov_base = buffer.data();
+        segments_[band].iov_len = end - buffer.data();
+    });
+
+    size_ = 0;
+    for (const iovec& segment : segments_) {
+        size_ += segment.iov_len;
+    }
+}
+
+void AnsiSerializer::write(std::ostream& os) const {
+    for (const iovec& segment : segments_) {
+        os.write(static_cast<const char*>(segment.iov_base), segment.iov_len);
+    }
+    os.flush();
+}
+
+bool AnsiSerializer::write(int fd) const {
+    std::vector<iovec> pending = segments_;
+    size_t first = 0;
+    while (first < pending.size()) {
+        const ssize_t written = ::writev(fd, pending.data() + first, static_cast<int>(pending.size() - first));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip what the kernel took, possibly stopping in the middle of a segment.
+        size_t left = static_cast<size_t>(written);
+        while (first < pending.size() && left >= pending[first].iov_len) {
+            left -= pending[first].iov_len;
+            ++first;
+        }
+        if (first < pending.size()) {
+            pending[first].iov_base = static_cast<char*>(pending[first].iov_base) + left;
+            pending[first].iov_len -= left;
+        }
+    }
+    return true;
+}
+
+const std::vector<iovec>& AnsiSerializer::segments() const {
+    return segments_;
+}
+
+size_t AnsiSerializer::encoded_bytes() const {
+    return size_;
+}
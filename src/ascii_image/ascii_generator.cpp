@@ -1,6 +1,7 @@
 #include "ascii_generator.hpp"
 #include "color_utils.hpp"
 #include "ascii_image.hpp"
+#include "frame_trace.hpp"
 #include <iostream>
 #include <cmath>
 
@@ -14,42 +15,308 @@ void AsciiGenerator::set_desired_dimensions(int width, int height) {
     default_height_ = height;
 }
 
+void AsciiGenerator::set_prefer_baked(bool prefer_baked) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    prefer_baked_ = prefer_baked;
+}
+
+void AsciiGenerator::set_use_baked(bool use_baked) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    use_baked_ = use_baked;
+}
+
+void AsciiGenerator::set_glyph_mode(GlyphMode mode) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    glyph_mode_ = mode;
+}
+
+void AsciiGenerator::set_tone(const ToneSettings& settings) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    tone_.set_settings(settings);
+    custom_tone_ = true;
+    settings_generation_++;
+    results_.clear();
+    result_index_.clear();
+    stats_.result_entries = 0;
+    stats_.result_bytes = 0;
+}
+
+void AsciiGenerator::set_dither(DitherMode mode, PaletteMode palette) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    dither_ = mode;
+    dither_palette_ = palette;
+    settings_generation_++;
+    results_.clear();
+    result_index_.clear();
+    stats_.result_entries = 0;
+    stats_.result_bytes = 0;
+}
+
+bool AsciiGenerator::ResultKey::operator==(const ResultKey& other) const {
+    return width == other.width && height == other.height && greyscale == other.greyscale && mode == other.mode &&
+           path == other.path;
+}
+
+size_t AsciiGenerator::ResultKeyHash::operator()(const ResultKey& key) const {
+    size_t h = std::hash<std::string>()(key.path);
+    h ^= std::hash<int>()(key.width) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<int>()(key.height) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h ^ static_cast<size_t>(key.greyscale) ^ (static_cast<size_t>(key.mode) << 1);
+}
+
+void AsciiGenerator::set_cache_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    cache_budget_ = bytes;
+    while (stats_.result_bytes > cache_budget_ && !results_.empty()) {
+        stats_.result_bytes -= results_.back().bytes;
+        result_index_.erase(results_.back().key);
+        results_.pop_back();
+    }
+    stats_.result_entries = results_.size();
+}
+
+void AsciiGenerator::set_source_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    source_budget_ = bytes;
+    evict_sources(0);
+}
+
+// Drops least recently used sources until incoming more bytes fit. Needs cache_mutex_ held.
+void AsciiGenerator::evict_sources(size_t incoming) {
+    while (stats_.source_bytes + incoming > source_budget_ && !sources_.empty()) {
+        stats_.source_bytes -= sources_.back().bytes;
+        source_index_.erase(sources_.back().path);
+        sources_.pop_back();
+    }
+    stats_.source_entries = sources_.size();
+}
+
+AsciiCacheStats AsciiGenerator::cache_stats() const {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    return stats_;
+}
+
+void AsciiGenerator::clear_cache() {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    sources_.clear();
+    source_index_.clear();
+    baked_.clear();
+    results_.clear();
+    result_index_.clear();
+    stats_.source_entries = 0;
+    stats_.source_bytes = 0;
+    stats_.result_entries = 0;
+    stats_.result_bytes = 0;
+}
+
+cv::Mat AsciiGenerator::load_source(const std::string& image_path, std::filesystem::file_time_type mtime, bool cacheable) {
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto it = source_index_.find(image_path);
+        if (it != source_index_.end() && it->second->mtime == mtime) {
+            sources_.splice(sources_.begin(), sources_, it->second);
+            stats_.decode_hits++;
+            return it->second->image;
+        }
+        stats_.decode_misses++;
+    }
 
-AsciiImage AsciiGenerator::generate_ascii_from_file(const std::string& image_path, int width, int height) {
     // Load image using OpenCV
-    cv::Mat img = cv::imread(image_path);
+    cv::Mat img;
+    {
+        frame_trace::Scope scope("decode");
+        img = cv::imread(image_path);
+    }
     if (img.empty()) {
         std::cerr << "Error: Could not load image " << image_path << std::endl;
     }
-    int w = img.size().width;
-    int h = img.size().height;
+    else if (cacheable) {
+        const size_t bytes = img.total() * img.elemSize();
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto existing = source_index_.find(image_path);
+        if (existing != source_index_.end()) {
+            stats_.source_bytes -= existing->second->bytes;
+            sources_.erase(existing->second);
+            source_index_.erase(existing);
+        }
+        if (bytes <= source_budget_) {
+            evict_sources(bytes);
+            sources_.push_front(SourceEntry{image_path, mtime, img, bytes});
+            source_index_.emplace(image_path, sources_.begin());
+            stats_.source_bytes += bytes;
+        }
+        stats_.source_entries = sources_.size();
+    }
+    return img;
+}
+
+bool AsciiGenerator::load_baked(const std::string& image_path, const std::filesystem::file_time_type* source_mtime,
+                                int width, int height, AsciiImage& out) {
+    const std::string baked_path = std::filesystem::path(image_path).replace_extension(".acg").string();
+    std::error_code ec;
+    const auto mtime = std::filesystem::last_write_time(baked_path, ec);
+    if (ec) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (!use_baked_) {
+        return false;
+    }
+    // Baked before the image was last edited, its cells are out of date.
+    if (source_mtime && mtime < *source_mtime) {
+        baked_.erase(baked_path);
+        return false;
+    }
+    // A file that didn't parse is remembered too, so it is only opened (and reported) again once it changes.
+    auto found = baked_.find(baked_path);
+    if (found == baked_.end() || found->second.mtime != mtime) {
+        found = baked_.insert_or_assign(baked_path, BakedEntry{mtime, BakedAsset::open(baked_path)}).first;
+    }
+    const BakedEntry& entry = found->second;
+    // Only levels baked with the same glyph mode look like a fresh conversion would.
+    const bool shape_glyphs = entry.asset && (entry.asset->flags() & kBakedShapeGlyphs);
+    if (!entry.asset || custom_tone_ || dither_ != DitherMode::None || shape_glyphs != (glyph_mode_ == GlyphMode::Shape)) {
+        return false;
+    }
+    // Levels are stored as final cell grids, already stretched horizontally.
+    const int columns = cvRound(width * AsciiImage::default_horizontal_scale);
+    const BakedLevel* level = prefer_baked_ ? entry.asset->fit(columns, height) : entry.asset->find(columns, height);
+    if (!level) {
+        return false;
+    }
+    stats_.baked_hits++;
+    out = AsciiImage(entry.asset, *level);
+    return true;
+}
 
-    // Determine target dimensions: prefer explicit params, then defaults, then original image size.
-    if (width != -1) {
-        w = width;
-    } 
-    else {
-        if (default_width_ != -1) {
-            w = default_width_;
+void AsciiGenerator::store_result(ResultKey key, std::filesystem::file_time_type mtime, const AsciiImage& image,
+                                  const GlyphLut& lut, uint64_t generation) {
+    const cv::Mat4b& cells = image.get_cells();
+    const size_t bytes = cells.total() * cells.elemSize();
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    // Converted with settings that have changed since, a later request must not find it.
+    if (bytes > cache_budget_ || generation != settings_generation_) {
+        return;
+    }
+    auto existing = result_index_.find(key);
+    if (existing != result_index_.end()) {
+        stats_.result_bytes -= existing->second->bytes;
+        results_.erase(existing->second);
+        result_index_.erase(existing);
+    }
+    while (stats_.result_bytes + bytes > cache_budget_ && !results_.empty()) {
+        stats_.result_bytes -= results_.back().bytes;
+        result_index_.erase(results_.back().key);
+        results_.pop_back();
+    }
+    results_.push_front(ResultEntry{key, mtime, image, lut, bytes});
+    result_index_.emplace(std::move(key), results_.begin());
+    stats_.result_bytes += bytes;
+    stats_.result_entries = results_.size();
+}
+
+
+AsciiImage AsciiGenerator::generate_ascii_from_file(const std::string& image_path, int width, int height, bool greyscale) {
+    AsciiImage ascii_mat = AsciiImage(AsciiImageData());
+    generate_ascii_from_file(image_path, width, height, greyscale, [] { return false; }, ascii_mat);
+    return(ascii_mat);
+}
+
+bool AsciiGenerator::generate_ascii_from_file(const std::string& image_path, int width, int height, bool greyscale,
+                                              const CancelCheck& cancelled, AsciiImage& out, GlyphLut* lut) {
+    // Determine requested dimensions: prefer explicit params, then defaults, -1 keeps the original image size.
+    if (width == -1) {
+        width = default_width_;
+    }
+    if (height == -1) {
+        height = default_height_;
+    }
+
+    // The modification time keys both caches, if it can't be read nothing is cached.
+    std::error_code ec;
+    const auto mtime = std::filesystem::last_write_time(image_path, ec);
+    const bool cacheable = !ec;
+    GlyphMode mode;
+    ToneMapper tone;
+    DitherMode dither_mode;
+    PaletteMode dither_palette;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        generation = settings_generation_;
+        mode = glyph_mode_;
+        tone = tone_;
+        dither_mode = dither_;
+        dither_palette = dither_palette_;
+    }
+    ResultKey key{image_path, width, height, greyscale, mode};
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto it = result_index_.find(key);
+        if (it != result_index_.end() && it->second->mtime == mtime) {
+            results_.splice(results_.begin(), results_, it->second);
+            stats_.result_hits++;
+            out = it->second->image;
+            if (lut) {
+                *lut = it->second->lut;
+            }
+            return true;
         }
-    }   
-    if (height != -1) {
-        h = height;
-    } 
-    else {
-        if (default_height_ != -1) {
-            h = default_height_;
+        stats_.result_misses++;
+    }
+
+    // Pre-baked levels skip decoding entirely, the cells are paged in from the mapping on first use.
+    if (width != -1 && height != -1 && load_baked(image_path, cacheable ? &mtime : nullptr, width, height, out)) {
+        out.set_greyscale(greyscale);
+        // Baked assets are only used with the default tone, which has no exposure to measure.
+        if (lut) {
+            *lut = tone.lut();
         }
+        return true;
     }
 
-    // Resize image
-    cv::Mat resized_img;
-    cv::resize(img, resized_img, cv::Size(w, h), 0, 0, cv::INTER_LANCZOS4);
-    // Convert to RGB color space
+    cv::Mat img = load_source(image_path, mtime, cacheable);
+    if (img.empty() || cancelled()) {
+        return false;
+    }
+    int w = (width != -1) ? width : img.size().width;
+    int h = (height != -1) ? height : img.size().height;
+
+    // Resize image, shape matching needs a full glyph cell of pixels for every output column
+    const cv::Size size = mode == GlyphMode::Shape
+        ? glyph_matcher::detail_size(cvRound(w * AsciiImage::default_horizontal_scale), h)
+        : cv::Size(w, h);
     cv::Mat3b rgb_img;
-    cv::cvtColor(resized_img, rgb_img, cv::COLOR_BGR2RGB);
+    {
+        frame_trace::Scope scope("resize");
+        cv::Mat resized_img;
+        cv::resize(img, resized_img, size, 0, 0, mode == GlyphMode::Shape ? cv::INTER_AREA : cv::INTER_LANCZOS4);
+        // Convert to RGB color space
+        cv::cvtColor(resized_img, rgb_img, cv::COLOR_BGR2RGB);
+    }
+    if (cancelled()) {
+        return false;
+    }
     
-    AsciiImage ascii_mat = AsciiImage(rgb_img);
+    // Stills are exposed on their own, without smoothing against earlier images.
+    tone.observe(rgb_img);
+    AsciiImage ascii_mat = mode == GlyphMode::Shape
+        ? AsciiImage(AsciiImageData(glyph_matcher::match(rgb_img, tone.lut()), greyscale))
+        : AsciiImage(rgb_img, AsciiImage::default_horizontal_scale, tone.lut());
+    ascii_mat.set_greyscale(greyscale);
+    if (dither_mode != DitherMode::None) {
+        ascii_mat.set_palette(dither_palette);
+        dither::apply(ascii_mat, dither_mode, tone.lut(), mode != GlyphMode::Shape);
+    }
+    if (cacheable) {
+        store_result(std::move(key), mtime, ascii_mat, tone.lut(), generation);
+    }
+    if (lut) {
+        *lut = tone.lut();
+    }
     // ascii_mat.print();
-    return(ascii_mat);
+    out = ascii_mat;
+    return true;
 }
@@ -1,34 +1,167 @@
 #include <ascii_image.hpp>
+#include <ansi_serializer.hpp>
+#include <parallel_rows.hpp>
+#include <frame_trace.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
-AsciiImage::AsciiImage(cv::Mat3b img_matrix, float horizontal_scale_factor){
-    cv::Mat mat(img_matrix.size().height, img_matrix.size().width, CV_8UC4);
-    for (int i = 0; i < mat.rows; ++i) {
-        for (int j = 0; j < mat.cols; ++j) {
-            // Read from the input image
-            cv::Vec3b pixel = img_matrix.at<cv::Vec3b>(i, j);
-            
-            // Calculate brightness using the input image pixel values
-            int brightness = (0.2126 * pixel[2]) + (0.7152 * pixel[1]) + (0.0722 * pixel[0]); // BGR format
-            char ascii_char = ColorUtils::get_ascii_char(brightness);
-            
-            // Store RGB values and ASCII character in our matrix
-            cv::Vec4b& v = mat.at<cv::Vec4b>(i, j);
-            v[0] = pixel[0]; // R
-            v[1] = pixel[1]; // G  
-            v[2] = pixel[2]; // B
-            v[3] = static_cast<unsigned char>(ascii_char);
+namespace {
+
+// Rec. 709 luma weights in 8.8 fixed point, they sum to 256 so white stays at 255.
+constexpr int kLumaR = 54;
+constexpr int kLumaG = 183;
+constexpr int kLumaB = 19;
+// Smaller bands cost more in scheduling than they gain.
+constexpr int kMinBandRows = 16;
+
+inline uchar luma(uchar r, uchar g, uchar b) {
+    return static_cast<uchar>((kLumaR * r + kLumaG * g + kLumaB * b + 128) >> 8);
+}
+
+// Converts one row of RGB pixels into packed RGB+glyph cells (4 bytes each).
+// The vector path and the scalar tail compute exactly the same luma.
+void convert_row(const uchar* src, uchar* cells, int cols, const GlyphLut& lut) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint16 wr = cv::vx_setall_u16(kLumaR);
+    const cv::v_uint16 wg = cv::vx_setall_u16(kLumaG);
+    const cv::v_uint16 wb = cv::vx_setall_u16(kLumaB);
+    const cv::v_uint16 half = cv::vx_setall_u16(128);
+    uchar lum[cv::VTraits<cv::v_uint8>::max_nlanes];
+    uchar glyph[cv::VTraits<cv::v_uint8>::max_nlanes];
+    for (; x <= cols - lanes; x += lanes) {
+        cv::v_uint8 r, g, b;
+        cv::v_load_deinterleave(src + 3 * x, r, g, b);
+        cv::v_uint16 r0, r1, g0, g1, b0, b1;
+        cv::v_expand(r, r0, r1);
+        cv::v_expand(g, g0, g1);
+        cv::v_expand(b, b0, b1);
+        // Max sum is 255 * 256 + 128, so 16 bit lanes never overflow.
+        cv::v_uint16 y0 = cv::v_add(cv::v_add(cv::v_mul_wrap(r0, wr), cv::v_mul_wrap(g0, wg)),
+                                    cv::v_add(cv::v_mul_wrap(b0, wb), half));
+        cv::v_uint16 y1 = cv::v_add(cv::v_add(cv::v_mul_wrap(r1, wr), cv::v_mul_wrap(g1, wg)),
+                                    cv::v_add(cv::v_mul_wrap(b1, wb), half));
+        cv::v_store(lum, cv::v_pack(cv::v_shr<8>(y0), cv::v_shr<8>(y1)));
+        for (int i = 0; i < lanes; ++i) {
+            glyph[i] = static_cast<uchar>(lut[lum[i]]);
+        }
+        cv::v_store_interleave(cells + 4 * x, r, g, b, cv::vx_load(glyph));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < cols; ++x) {
+        const uchar* p = src + 3 * x;
+        uchar* c = cells + 4 * x;
+        c[0] = p[0];
+        c[1] = p[1];
+        c[2] = p[2];
+        c[3] = static_cast<uchar>(lut[luma(p[0], p[1], p[2])]);
+    }
+}
+
+}  // namespace
+
+AsciiImage::AsciiImage(cv::Mat3b img_matrix, float horizontal_scale_factor)
+    : AsciiImage(img_matrix, horizontal_scale_factor, ColorUtils::glyph_lut()) {
+}
+
+AsciiImage::AsciiImage(const cv::Mat3b& img_matrix, float horizontal_scale_factor, const GlyphLut& lut){
+    frame_trace::Scope scope("ascii_image");
+    const int src_cols = img_matrix.cols;
+    const int rows = img_matrix.rows;
+    const int out_cols = cvRound(src_cols * horizontal_scale_factor);
+    data.mat_.create(rows, out_cols);
+    if (rows == 0 || out_cols <= 0) {
+        return;
+    }
+
+    // Nearest neighbour column map, so every output cell repeats a whole source cell
+    // instead of interpolating colours and glyph bytes.
+    const bool identity = (out_cols == src_cols);
+    std::vector<int> x_map;
+    if (!identity) {
+        x_map.resize(out_cols);
+        const double inv_scale = static_cast<double>(src_cols) / out_cols;
+        for (int x = 0; x < out_cols; ++x) {
+            x_map[x] = std::min(static_cast<int>(x * inv_scale), src_cols - 1);
         }
     }
-    cv::resize(mat,data.mat_,cv::Size(),horizontal_scale_factor,1); // this also stores the matrix in mat_
+
+    // Row bands are independent, each one keeps its own scratch row.
+    const int bands = parallel_rows::band_count(rows, kMinBandRows);
+    parallel_rows::run(rows, bands, [&](int, int first_row, int end_row) {
+        std::vector<uchar> packed(identity ? 0 : 4 * static_cast<size_t>(src_cols));
+        for (int y = first_row; y < end_row; ++y) {
+            const uchar* src = img_matrix.ptr<uchar>(y);
+            uchar* dst = data.mat_.ptr<uchar>(y);
+            if (identity) {
+                convert_row(src, dst, src_cols, lut);
+                continue;
+            }
+            convert_row(src, packed.data(), src_cols, lut);
+            for (int x = 0; x < out_cols; ++x) {
+                std::memcpy(dst + 4 * x, packed.data() + 4 * x_map[x], 4);
+            }
+        }
+    });
 }
 AsciiImage::AsciiImage(AsciiImageData data){
-    this->data = data;
+    this->data = std::move(data);
+}
+
+AsciiImage::AsciiImage(std::shared_ptr<BakedAsset> asset, const BakedLevel& level){
+    data.mat_ = cv::Mat4b(level.height, level.width, reinterpret_cast<cv::Vec4b*>(level.cells));
+    data.greyscale = asset->greyscale();
+    data.owner = std::move(asset);
 }
 
-cv::Mat AsciiImage::get_matrix(){
+const cv::Mat4b& AsciiImage::get_matrix() const{
     return(data.mat_);
 }
 
+const cv::Mat4b& AsciiImage::get_cells() const{
+    return(data.mat_);
+}
+
+bool AsciiImage::is_shared() const{
+    // Matrices over borrowed memory have no refcount, their owner may hand the cells to others.
+    // Other threads drop their copies with an atomic decrement (CV_XADD). Acquiring the count
+    // orders their last reads of the cells before any write made here after seeing it fall to one.
+    return(data.owner || !data.mat_.u || __atomic_load_n(&data.mat_.u->refcount, __ATOMIC_ACQUIRE) > 1);
+}
+
+void AsciiImage::detach(){
+    if (data.mat_.empty() || !is_shared()) {
+        return;
+    }
+    data.mat_ = data.mat_.clone();
+    data.owner.reset();
+}
+
+cv::Mat4b& AsciiImage::mutable_cells(){
+    detach();
+    return(data.mat_);
+}
+
+void AsciiImage::set_palette(PaletteMode palette){
+    data.palette = palette;
+}
+
+PaletteMode AsciiImage::get_palette() const{
+    return(data.palette);
+}
+
+bool AsciiImage::has_color() const{
+    return(!data.greyscale && data.palette != PaletteMode::Mono);
+}
+
+bool AsciiImage::is_greyscale() const{
+    return(data.greyscale);
+}
+
 void AsciiImage::print(){
     std::cout << *this;
 }
@@ -37,13 +170,47 @@ void AsciiImage::set_greyscale(bool grey){
     data.greyscale = grey;
 }
 
-AsciiImage AsciiImage::crop(int x, int y, int size_x, int size_y){
-    AsciiImage result = AsciiImage(data);
-    result.data.mat_ = data.mat_(cv::Rect(x, y, size_x, size_y)).clone();
+AsciiImage AsciiImage::crop(int x, int y, int size_x, int size_y) const &{
+    return AsciiImage(*this).crop(x, y, size_x, size_y);
+}
+
+AsciiImage AsciiImage::crop(int x, int y, int size_x, int size_y) &&{
+    const cv::Rect region = cv::Rect(x, y, size_x, size_y) & cv::Rect(0, 0, data.mat_.cols, data.mat_.rows);
+    AsciiImage result = AsciiImage(std::move(data));
+    result.data.mat_ = result.data.mat_(region);
     return result;
 }
-AsciiImage AsciiImage::scale(float x,float y){
-    AsciiImage result = AsciiImage(data);
-    cv::resize(data.mat_,result.data.mat_,cv::Size(),x,y);
-    return(result);
-}
\ No newline at end of file
+
+AsciiImage& AsciiImage::translate(int dx, int dy){
+    if (data.mat_.empty()) {
+        return *this;
+    }
+    cv::Size whole;
+    cv::Point offset;
+    data.mat_.locateROI(whole, offset);
+    dx = std::clamp(dx, -offset.x, whole.width - offset.x - data.mat_.cols);
+    dy = std::clamp(dy, -offset.y, whole.height - offset.y - data.mat_.rows);
+    // Shrinking one side and growing the other by the same amount keeps the size.
+    data.mat_.adjustROI(-dy, dy, -dx, dx);
+    return *this;
+}
+
+AsciiImage AsciiImage::scale(float x,float y) const{
+    // Resized cells always get new storage, never the storage this image shares.
+    AsciiImageData scaled = data;
+    scaled.mat_ = cv::Mat4b();
+    scaled.owner.reset();
+    cv::resize(data.mat_,scaled.mat_,cv::Size(),x,y,cv::INTER_NEAREST);
+    return(AsciiImage(std::move(scaled)));
+}
+
+std::ostream& operator<< (std::ostream& os, const AsciiImage& mat){
+    thread_local AnsiSerializer serializer;
+    {
+        frame_trace::Scope scope("serialize");
+        serializer.encode(mat);
+    }
+    frame_trace::Scope scope("flush");
+    serializer.write(os);
+    return(os);
+}
@@ -0,0 +1,265 @@
+#include "ascii_video.hpp"
+#include "frame_trace.hpp"
+#include <iostream>
+
+namespace {
+
+// Image sequences don't report a rate.
+constexpr double kDefaultFps = 24.0;
+
+}  // namespace
+
+AsciiVideoSource::AsciiVideoSource(size_t decode_capacity, size_t present_capacity)
+    : decoded_(decode_capacity), converted_(present_capacity) {
+}
+
+AsciiVideoSource::~AsciiVideoSource() {
+    close();
+}
+
+bool AsciiVideoSource::open(const std::string& source, double target_fps) {
+    close();
+
+    files_.clear();
+    file_index_ = 0;
+    if (source.find_first_of("*?") != std::string::npos) {
+        cv::glob(source, files_, false);
+        source_fps_ = kDefaultFps;
+        if (files_.empty()) {
+            std::cerr << "Error: No frames match " << source << std::endl;
+            return false;
+        }
+    }
+    else {
+        if (!capture_.open(source)) {
+            std::cerr << "Error: Could not open video " << source << std::endl;
+            return false;
+        }
+        source_fps_ = capture_.get(cv::CAP_PROP_FPS);
+        if (source_fps_ <= 0) {
+            source_fps_ = kDefaultFps;
+        }
+    }
+    target_fps_ = (target_fps > 0) ? std::min(target_fps, source_fps_) : source_fps_;
+
+    decoded_.reopen();
+    converted_.reopen();
+    start_ = 0;
+    convert_done_ = false;
+    decoded_frames_ = converted_frames_ = presented_frames_ = 0;
+    dropped_rate_ = dropped_late_ = dropped_stale_ = 0;
+    running_ = true;
+    open_ = true;
+    decode_thread_ = std::thread([this] {
+        frame_trace::set_thread_name("video decode");
+        decode_loop();
+    });
+    convert_thread_ = std::thread([this] {
+        frame_trace::set_thread_name("video convert");
+        convert_loop();
+    });
+    return true;
+}
+
+void AsciiVideoSource::close() {
+    running_ = false;
+    decoded_.close();
+    converted_.close();
+    if (decode_thread_.joinable()) {
+        decode_thread_.join();
+    }
+    if (convert_thread_.joinable()) {
+        convert_thread_.join();
+    }
+    capture_.release();
+    open_ = false;
+}
+
+bool AsciiVideoSource::is_open() const {
+    return open_;
+}
+
+bool AsciiVideoSource::finished() const {
+    return convert_done_ && converted_.size() == 0;
+}
+
+void AsciiVideoSource::set_output_size(int width, int height) {
+    out_width_ = width;
+    out_height_ = height;
+}
+
+void AsciiVideoSource::set_loop(bool loop) {
+    loop_ = loop;
+}
+
+void AsciiVideoSource::set_glyph_mode(GlyphMode mode) {
+    glyph_mode_ = mode;
+}
+
+void AsciiVideoSource::set_tone(const ToneSettings& settings) {
+    std::lock_guard<std::mutex> lock(tone_mutex_);
+    tone_settings_ = settings;
+    tone_changed_ = true;
+}
+
+void AsciiVideoSource::set_dither(DitherMode mode, PaletteMode palette) {
+    dither_palette_ = palette;
+    dither_mode_ = mode;
+}
+
+bool AsciiVideoSource::read_frame(cv::Mat& out) {
+    frame_trace::Scope scope("decode");
+    if (!files_.empty()) {
+        while (file_index_ < files_.size()) {
+            out = cv::imread(files_[file_index_++]);
+            if (!out.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return capture_.read(out) && !out.empty();
+}
+
+bool AsciiVideoSource::rewind() {
+    if (!files_.empty()) {
+        file_index_ = 0;
+        return true;
+    }
+    return capture_.set(cv::CAP_PROP_POS_FRAMES, 0);
+}
+
+void AsciiVideoSource::decode_loop() {
+    const double source_step = 1.0 / source_fps_;
+    const double target_step = 1.0 / target_fps_;
+    double source_time = 0;
+    double next_emit = 0;
+    size_t index = 0;
+    cv::Mat image;
+
+    while (running_) {
+        if (!read_frame(image)) {
+            if (!loop_ || index == 0 || !rewind()) {
+                break;
+            }
+            continue;
+        }
+        const double timestamp = source_time;
+        source_time += source_step;
+        // Decimate down to the target rate, half a source frame of slack avoids rounding misses.
+        if (timestamp + source_step / 2 < next_emit) {
+            dropped_rate_++;
+            continue;
+        }
+        next_emit += target_step;
+        decoded_frames_++;
+        // Blocks while the converter is behind and the queue is full.
+        if (!decoded_.push(DecodedFrame{image.clone(), timestamp, index++})) {
+            break;
+        }
+    }
+    decoded_.close();
+}
+
+void AsciiVideoSource::convert_loop() {
+    DecodedFrame decoded;
+    ToneMapper tone;
+    while (decoded_.pop(decoded)) {
+        if (tone_changed_.exchange(false)) {
+            std::lock_guard<std::mutex> lock(tone_mutex_);
+            tone.set_settings(tone_settings_);
+        }
+        // Skip frames that are already overdue while newer ones are waiting.
+        if (start_ != 0 && decoded_.size() > 0 &&
+            decoded.timestamp + 1.0 / target_fps_ < playback_time(Clock::now())) {
+            dropped_late_++;
+            continue;
+        }
+
+        const int w = (out_width_ > 0) ? out_width_.load() : decoded.image.cols;
+        const int h = (out_height_ > 0) ? out_height_.load() : decoded.image.rows;
+        const bool shape = glyph_mode_ == GlyphMode::Shape;
+        const cv::Size size = shape ? glyph_matcher::detail_size(cvRound(w * AsciiImage::default_horizontal_scale), h) : cv::Size(w, h);
+        cv::Mat3b rgb_img;
+        {
+            frame_trace::Scope scope("resize");
+            cv::Mat resized_img;
+            cv::resize(decoded.image, resized_img, size, 0, 0, cv::INTER_AREA);
+            cv::cvtColor(resized_img, rgb_img, cv::COLOR_BGR2RGB);
+        }
+
+        tone.observe(rgb_img);
+
+        AsciiFrame frame;
+        frame.image = shape ? AsciiImage(AsciiImageData(glyph_matcher::match(rgb_img, tone.lut()), false))
+                            : AsciiImage(rgb_img, AsciiImage::default_horizontal_scale, tone.lut());
+        const DitherMode dither_mode = dither_mode_;
+        if (dither_mode != DitherMode::None) {
+            frame.image.set_palette(dither_palette_);
+            dither::apply(frame.image, dither_mode, tone.lut(), !shape);
+        }
+        frame.timestamp = decoded.timestamp;
+        frame.index = decoded.index;
+        frame.lut = tone.lut();
+        frame.shape_glyphs = shape;
+        converted_frames_++;
+        // Blocks while the presenter has enough frames queued.
+        if (!converted_.push(std::move(frame))) {
+            break;
+        }
+    }
+    convert_done_ = true;
+}
+
+double AsciiVideoSource::playback_time(Clock::time_point now) const {
+    const Clock::time_point start{Clock::duration(start_.load())};
+    return std::chrono::duration<double>(now - start).count();
+}
+
+bool AsciiVideoSource::frame_for(Clock::time_point now, AsciiFrame& frame) {
+    AsciiFrame head;
+    if (!converted_.peek(head)) {
+        return false;
+    }
+    if (start_ == 0) {
+        // Playback starts with the first converted frame.
+        start_ = (now - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(head.timestamp)))
+                     .time_since_epoch().count();
+    }
+
+    const double t = playback_time(now);
+    bool found = false;
+    while (converted_.peek(head) && head.timestamp <= t) {
+        if (found) {
+            dropped_stale_++;
+        }
+        converted_.try_pop(frame);
+        found = true;
+    }
+    if (found) {
+        presented_frames_++;
+    }
+    return found;
+}
+
+AsciiVideoSource::Clock::time_point AsciiVideoSource::next_deadline(Clock::time_point now) const {
+    AsciiFrame head;
+    if (start_ != 0 && converted_.peek(head)) {
+        const Clock::time_point start{Clock::duration(start_.load())};
+        return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(head.timestamp));
+    }
+    return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (target_fps_ > 0 ? target_fps_ : kDefaultFps)));
+}
+
+VideoPipelineStats AsciiVideoSource::stats() const {
+    VideoPipelineStats stats;
+    stats.decode_queue_depth = decoded_.size();
+    stats.present_queue_depth = converted_.size();
+    stats.decoded_frames = decoded_frames_;
+    stats.converted_frames = converted_frames_;
+    stats.presented_frames = presented_frames_;
+    stats.dropped_rate = dropped_rate_;
+    stats.dropped_late = dropped_late_;
+    stats.dropped_stale = dropped_stale_;
+    return stats;
+}
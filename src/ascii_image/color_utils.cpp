@@ -16,4 +16,15 @@ char ColorUtils::get_ascii_char(int brightness) {
     int k = static_cast<int>(brightness / 256.0 * n);
     k = std::min(k, n - 1);  // Ensure k doesn't exceed bounds
     return full_density_range[n - 1 - k];
-}
\ No newline at end of file
+}
+
+const GlyphLut& ColorUtils::glyph_lut() {
+    static const GlyphLut lut = [] {
+        GlyphLut table{};
+        for (int brightness = 0; brightness < 256; ++brightness) {
+            table[brightness] = get_ascii_char(brightness);
+        }
+        return table;
+    }();
+    return lut;
+}
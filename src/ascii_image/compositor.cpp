@@ -0,0 +1,344 @@
+#include "compositor.hpp"
+#include "frame_trace.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Past this many separate rectangles one bounding rectangle is cheaper to walk.
+constexpr size_t kMaxDirtyRects = 32;
+constexpr uint8_t kBlankGlyph = ' ';
+// Output grids in rotation: the one on screen, the one handed on, and one to draw into.
+constexpr size_t kOutputCount = 3;
+
+// Adds rect to rects, merging it with any rectangle whose union wastes less than their overlap saves.
+void add_rect(std::vector<cv::Rect>& rects, cv::Rect rect) {
+    for (size_t i = 0; i < rects.size();) {
+        const cv::Rect merged = rects[i] | rect;
+        if (merged.area() <= rects[i].area() + rect.area()) {
+            // The merged rectangle may now reach ones already passed over.
+            rect = merged;
+            rects[i] = rects.back();
+            rects.pop_back();
+            i = 0;
+            continue;
+        }
+        ++i;
+    }
+    rects.push_back(rect);
+    if (rects.size() > kMaxDirtyRects) {
+        cv::Rect bounds = rects[0];
+        for (const cv::Rect& r : rects) {
+            bounds = bounds | r;
+        }
+        rects.assign(1, bounds);
+    }
+}
+
+// Draws count packed cells over the planes, skipping cells whose glyph is key (-1 for none).
+void blend_row(const uchar* cells, uchar* red, uchar* green, uchar* blue, uchar* glyph, int count, int key) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    if (key < 0) {
+        for (; x <= count - lanes; x += lanes) {
+            cv::v_uint8 r, g, b, c;
+            cv::v_load_deinterleave(cells + 4 * x, r, g, b, c);
+            cv::v_store(red + x, r);
+            cv::v_store(green + x, g);
+            cv::v_store(blue + x, b);
+            cv::v_store(glyph + x, c);
+        }
+    }
+    else {
+        const cv::v_uint8 key_lanes = cv::vx_setall_u8(static_cast<uchar>(key));
+        for (; x <= count - lanes; x += lanes) {
+            cv::v_uint8 r, g, b, c;
+            cv::v_load_deinterleave(cells + 4 * x, r, g, b, c);
+            const cv::v_uint8 keep = cv::v_eq(c, key_lanes);
+            cv::v_store(red + x, cv::v_select(keep, cv::vx_load(red + x), r));
+            cv::v_store(green + x, cv::v_select(keep, cv::vx_load(green + x), g));
+            cv::v_store(blue + x, cv::v_select(keep, cv::vx_load(blue + x), b));
+            cv::v_store(glyph + x, cv::v_select(keep, cv::vx_load(glyph + x), c));
+        }
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < count; ++x) {
+        const uchar* cell = cells + 4 * x;
+        if (cell[3] == key) {
+            continue;
+        }
+        red[x] = cell[0];
+        green[x] = cell[1];
+        blue[x] = cell[2];
+        glyph[x] = cell[3];
+    }
+}
+
+void pack_row(const uchar* red, const uchar* green, const uchar* blue, const uchar* glyph, uchar* cells, int count) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    for (; x <= count - lanes; x += lanes) {
+        cv::v_store_interleave(cells + 4 * x, cv::vx_load(red + x), cv::vx_load(green + x),
+                               cv::vx_load(blue + x), cv::vx_load(glyph + x));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < count; ++x) {
+        uchar* cell = cells + 4 * x;
+        cell[0] = red[x];
+        cell[1] = green[x];
+        cell[2] = blue[x];
+        cell[3] = glyph[x];
+    }
+}
+
+}  // namespace
+
+cv::Rect Compositor::Layer::bounds() const {
+    const cv::Mat4b& cells = image.get_cells();
+    return cv::Rect(position.x, position.y, cells.cols, cells.rows);
+}
+
+Compositor::Compositor() : outputs_(kOutputCount) {
+}
+
+Compositor::Compositor(cv::Size size) : outputs_(kOutputCount) {
+    resize(size);
+}
+
+void Compositor::resize(cv::Size size) {
+    size_ = cv::Size(std::max(0, size.width), std::max(0, size.height));
+    const size_t cells = static_cast<size_t>(size_.area());
+    red_.assign(cells, 0);
+    green_.assign(cells, 0);
+    blue_.assign(cells, 0);
+    glyph_.assign(cells, kBlankGlyph);
+    // The others are made at the new size when the rotation reaches them.
+    for (Output& output : outputs_) {
+        output.image = AsciiImage(AsciiImageData());
+        output.stale.clear();
+    }
+    current_ = 0;
+    outputs_[current_].image = AsciiImage(AsciiImageData(cv::Mat4b(size_.height, size_.width), false));
+    invalidate();
+}
+
+cv::Size Compositor::size() const {
+    return size_;
+}
+
+Compositor::Layer& Compositor::layer(LayerId id) {
+    return layers_[id];
+}
+
+Compositor::LayerId Compositor::add_layer(const AsciiImage& image, cv::Point position, int z, std::optional<uint8_t> key) {
+    LayerId id;
+    if (!free_ids_.empty()) {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+    }
+    else {
+        id = static_cast<LayerId>(layers_.size());
+        layers_.emplace_back();
+    }
+    Layer& added = layers_[id];
+    added.image = image;
+    added.position = position;
+    added.z = z;
+    added.key = key;
+    added.visible = true;
+    added.alive = true;
+    added.sequence = next_sequence_++;
+    order_valid_ = false;
+    mark(added);
+    return id;
+}
+
+void Compositor::remove_layer(LayerId id) {
+    Layer& removed = layer(id);
+    if (!removed.alive) {
+        return;
+    }
+    mark(removed);
+    // Drops the reference so the cells can be freed or written without a copy.
+    removed.image = AsciiImage(AsciiImageData());
+    removed.alive = false;
+    free_ids_.push_back(id);
+    order_valid_ = false;
+}
+
+void Compositor::set_image(LayerId id, const AsciiImage& image) {
+    Layer& changed = layer(id);
+    mark(changed);
+    changed.image = image;
+    mark(changed);
+}
+
+void Compositor::set_position(LayerId id, cv::Point position) {
+    Layer& moved = layer(id);
+    if (moved.position == position) {
+        return;
+    }
+    mark(moved);
+    moved.position = position;
+    mark(moved);
+}
+
+void Compositor::set_z(LayerId id, int z) {
+    Layer& changed = layer(id);
+    if (changed.z == z) {
+        return;
+    }
+    changed.z = z;
+    order_valid_ = false;
+    mark(changed);
+}
+
+void Compositor::set_key(LayerId id, std::optional<uint8_t> key) {
+    Layer& changed = layer(id);
+    if (changed.key == key) {
+        return;
+    }
+    changed.key = key;
+    mark(changed);
+}
+
+void Compositor::set_visible(LayerId id, bool visible) {
+    Layer& changed = layer(id);
+    if (changed.visible == visible) {
+        return;
+    }
+    changed.visible = visible;
+    order_valid_ = false;
+    invalidate(changed.bounds());
+}
+
+void Compositor::invalidate(const cv::Rect& region) {
+    const cv::Rect clipped = region & cv::Rect(0, 0, size_.width, size_.height);
+    if (!clipped.empty()) {
+        add_rect(dirty_, clipped);
+    }
+}
+
+void Compositor::invalidate() {
+    dirty_.clear();
+    invalidate(cv::Rect(0, 0, size_.width, size_.height));
+}
+
+void Compositor::mark(const Layer& marked) {
+    if (marked.visible) {
+        invalidate(marked.bounds());
+    }
+}
+
+void Compositor::sort_layers() {
+    order_.clear();
+    for (LayerId id = 0; id < static_cast<LayerId>(layers_.size()); ++id) {
+        if (layers_[id].alive && layers_[id].visible) {
+            order_.push_back(id);
+        }
+    }
+    std::sort(order_.begin(), order_.end(), [this](LayerId a, LayerId b) {
+        const Layer& la = layers_[a];
+        const Layer& lb = layers_[b];
+        return la.z != lb.z ? la.z < lb.z : la.sequence < lb.sequence;
+    });
+    order_valid_ = true;
+}
+
+void Compositor::compose_rect(const cv::Rect& rect) {
+    for (int y = rect.y; y < rect.br().y; ++y) {
+        const size_t offset = static_cast<size_t>(y) * size_.width + rect.x;
+        std::memset(red_.data() + offset, 0, rect.width);
+        std::memset(green_.data() + offset, 0, rect.width);
+        std::memset(blue_.data() + offset, 0, rect.width);
+        std::memset(glyph_.data() + offset, kBlankGlyph, rect.width);
+    }
+    for (LayerId id : order_) {
+        const Layer& drawn = layers_[id];
+        const cv::Rect overlap = drawn.bounds() & rect;
+        if (overlap.empty()) {
+            continue;
+        }
+        const cv::Mat4b& cells = drawn.image.get_cells();
+        const int key = drawn.key ? *drawn.key : -1;
+        for (int y = overlap.y; y < overlap.br().y; ++y) {
+            const uchar* source = cells.ptr<uchar>(y - drawn.position.y) + 4 * (overlap.x - drawn.position.x);
+            const size_t offset = static_cast<size_t>(y) * size_.width + overlap.x;
+            blend_row(source, red_.data() + offset, green_.data() + offset, blue_.data() + offset,
+                      glyph_.data() + offset, overlap.width, key);
+        }
+    }
+}
+
+void Compositor::pack_rect(const cv::Rect& rect, cv::Mat4b& cells) const {
+    for (int y = rect.y; y < rect.br().y; ++y) {
+        const size_t offset = static_cast<size_t>(y) * size_.width + rect.x;
+        pack_row(red_.data() + offset, green_.data() + offset, blue_.data() + offset, glyph_.data() + offset,
+                 cells.ptr<uchar>(y) + 4 * rect.x, rect.width);
+    }
+}
+
+bool Compositor::compose() {
+    composed_.clear();
+    if (dirty_.empty()) {
+        return false;
+    }
+    frame_trace::Scope scope("composite");
+    if (!order_valid_) {
+        sort_layers();
+    }
+    for (const cv::Rect& rect : dirty_) {
+        compose_rect(rect);
+        for (Output& output : outputs_) {
+            add_rect(output.stale, rect);
+        }
+    }
+
+    // Next grid in turn that no earlier frame still holds. When all are held the next one
+    // is copied by mutable_cells, and still only needs its stale rectangles packed.
+    size_t next = (current_ + 1) % outputs_.size();
+    bool all_held = true;
+    for (size_t i = 1; i <= outputs_.size(); ++i) {
+        const size_t candidate = (current_ + i) % outputs_.size();
+        const AsciiImage& image = outputs_[candidate].image;
+        if (image.get_cells().empty() || !image.is_shared()) {
+            next = candidate;
+            all_held = false;
+            break;
+        }
+    }
+    Output& output = outputs_[next];
+    const cv::Mat4b& grid = output.image.get_cells();
+    if (grid.cols != size_.width || grid.rows != size_.height) {
+        output.image = AsciiImage(AsciiImageData(cv::Mat4b(size_.height, size_.width), false));
+        output.stale.assign(1, cv::Rect(0, 0, size_.width, size_.height));
+    }
+    else if (all_held) {
+        copied_++;
+    }
+    cv::Mat4b& cells = output.image.mutable_cells();
+    for (const cv::Rect& rect : output.stale) {
+        pack_rect(rect, cells);
+    }
+    output.stale.clear();
+    current_ = next;
+    composed_.swap(dirty_);
+    return true;
+}
+
+const AsciiImage& Compositor::image() const {
+    return outputs_[current_].image;
+}
+
+const std::vector<cv::Rect>& Compositor::composed_rects() const {
+    return composed_;
+}
+
+size_t Compositor::copied_grids() const {
+    return copied_;
+}
@@ -0,0 +1,263 @@
+#include "dither.hpp"
+#include "palette.hpp"
+#include "parallel_rows.hpp"
+#include "frame_trace.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace {
+
+// Same 8.8 Rec. 709 weights as the AsciiImage conversion, so undithered cells keep their glyph.
+constexpr int kLumaR = 54;
+constexpr int kLumaG = 183;
+constexpr int kLumaB = 19;
+constexpr int kMinBandRows = 16;
+// Error diffusion wavefront: columns per task, and how many tasks a row trails the one above.
+constexpr int kChunkColumns = 8;
+constexpr int kChunkLag = 2;
+// Error buffers have two spare columns on each side for the kernels' reach.
+constexpr int kPad = 2;
+
+constexpr uint8_t kBayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+inline int luma(const uchar* cell) {
+    return (kLumaR * cell[0] + kLumaG * cell[1] + kLumaB * cell[2] + 128) >> 8;
+}
+
+// Brightness each lut entry stands for: the middle of the run of entries sharing its glyph.
+struct Levels {
+    std::array<uint8_t, 256> mid{};
+    int count = 0;
+};
+
+Levels levels_of(const GlyphLut& lut) {
+    Levels levels;
+    for (int lo = 0; lo < 256;) {
+        int hi = lo;
+        while (hi + 1 < 256 && lut[hi + 1] == lut[lo]) {
+            ++hi;
+        }
+        for (int b = lo; b <= hi; ++b) {
+            levels.mid[b] = static_cast<uint8_t>((lo + hi + 1) / 2);
+        }
+        levels.count++;
+        lo = hi + 1;
+    }
+    return levels;
+}
+
+// Rough distance between neighbouring palette entries on one channel.
+int palette_step(PaletteMode mode) {
+    switch (mode) {
+        case PaletteMode::Ansi256: return 40;   // xterm cube steps, 95 at the bottom
+        case PaletteMode::Ansi16:  return 128;
+        default:                   return 0;
+    }
+}
+
+// Threshold pattern for every row phase, tiled over the width and scaled to step.
+std::vector<short> bayer_offsets(int cols, int step) {
+    std::vector<short> offsets(8 * static_cast<size_t>(cols));
+    for (int phase = 0; phase < 8; ++phase) {
+        for (int x = 0; x < cols; ++x) {
+            offsets[phase * cols + x] = static_cast<short>(((2 * kBayer8[phase][x & 7] + 1) * step) / 128 - step / 2);
+        }
+    }
+    return offsets;
+}
+
+void ordered_row(uchar* cells, int cols, const GlyphLut& lut, const short* glyph_offsets, const short* color_offsets) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const int half = cv::VTraits<cv::v_uint16>::vlanes();
+    const cv::v_uint16 wr = cv::vx_setall_u16(kLumaR);
+    const cv::v_uint16 wg = cv::vx_setall_u16(kLumaG);
+    const cv::v_uint16 wb = cv::vx_setall_u16(kLumaB);
+    const cv::v_uint16 round = cv::vx_setall_u16(128);
+    uchar level[cv::VTraits<cv::v_uint8>::max_nlanes];
+    uchar glyph[cv::VTraits<cv::v_uint8>::max_nlanes];
+    // Adds signed offsets to 8 bit values, saturating at both ends.
+    auto offset = [](const cv::v_uint16& lo, const cv::v_uint16& hi, const short* by, int half_lanes) {
+        return cv::v_pack_u(cv::v_add(cv::v_reinterpret_as_s16(lo), cv::vx_load(by)),
+                            cv::v_add(cv::v_reinterpret_as_s16(hi), cv::vx_load(by + half_lanes)));
+    };
+    for (; x <= cols - lanes; x += lanes) {
+        cv::v_uint8 r, g, b, c;
+        cv::v_load_deinterleave(cells + 4 * x, r, g, b, c);
+        cv::v_uint16 r0, r1, g0, g1, b0, b1;
+        cv::v_expand(r, r0, r1);
+        cv::v_expand(g, g0, g1);
+        cv::v_expand(b, b0, b1);
+        if (glyph_offsets) {
+            const cv::v_uint16 y0 = cv::v_shr<8>(cv::v_add(cv::v_add(cv::v_mul_wrap(r0, wr), cv::v_mul_wrap(g0, wg)),
+                                                           cv::v_add(cv::v_mul_wrap(b0, wb), round)));
+            const cv::v_uint16 y1 = cv::v_shr<8>(cv::v_add(cv::v_add(cv::v_mul_wrap(r1, wr), cv::v_mul_wrap(g1, wg)),
+                                                           cv::v_add(cv::v_mul_wrap(b1, wb), round)));
+            cv::v_store(level, offset(y0, y1, glyph_offsets + x, half));
+            for (int i = 0; i < lanes; ++i) {
+                glyph[i] = static_cast<uchar>(lut[level[i]]);
+            }
+            c = cv::vx_load(glyph);
+        }
+        if (color_offsets) {
+            r = offset(r0, r1, color_offsets + x, half);
+            g = offset(g0, g1, color_offsets + x, half);
+            b = offset(b0, b1, color_offsets + x, half);
+        }
+        cv::v_store_interleave(cells + 4 * x, r, g, b, c);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < cols; ++x) {
+        uchar* cell = cells + 4 * x;
+        if (glyph_offsets) {
+            cell[3] = static_cast<uchar>(lut[std::clamp(luma(cell) + glyph_offsets[x], 0, 255)]);
+        }
+        if (color_offsets) {
+            for (int k = 0; k < 3; ++k) {
+                cell[k] = static_cast<uchar>(std::clamp(cell[k] + color_offsets[x], 0, 255));
+            }
+        }
+    }
+}
+
+// Error planes of the whole image, channel 0 is brightness and 1 to 3 are r, g, b.
+struct Diffusion {
+    const GlyphLut& lut;
+    const Levels& levels;
+    const Palette* palette;
+    bool glyphs;
+    bool atkinson;
+    int stride;
+    std::array<std::vector<int>, 4> error;
+};
+
+inline void spread(std::vector<int>& error, size_t at, int stride, int amount, bool atkinson) {
+    if (atkinson) {
+        const int share = amount / 8;
+        error[at + 1] += share;
+        error[at + 2] += share;
+        error[at + stride - 1] += share;
+        error[at + stride] += share;
+        error[at + stride + 1] += share;
+        error[at + 2 * stride] += share;
+        return;
+    }
+    const int right = amount * 7 / 16;
+    const int down_left = amount * 3 / 16;
+    const int down = amount * 5 / 16;
+    error[at + 1] += right;
+    error[at + stride - 1] += down_left;
+    error[at + stride] += down;
+    error[at + stride + 1] += amount - right - down_left - down;
+}
+
+void diffuse(Diffusion& d, uchar* row, int y, int first, int end) {
+    for (int x = first; x < end; ++x) {
+        uchar* cell = row + 4 * x;
+        const size_t at = static_cast<size_t>(y) * d.stride + x + kPad;
+        // Brightness first, it needs the colour before the palette step replaces it.
+        if (d.glyphs) {
+            const int v = std::clamp(luma(cell) + d.error[0][at], 0, 255);
+            cell[3] = static_cast<uchar>(d.lut[v]);
+            spread(d.error[0], at, d.stride, v - d.levels.mid[v], d.atkinson);
+        }
+        if (d.palette) {
+            int c[3];
+            for (int k = 0; k < 3; ++k) {
+                c[k] = std::clamp(cell[k] + d.error[k + 1][at], 0, 255);
+            }
+            const std::array<uint8_t, 3>& chosen = d.palette->color(d.palette->index(c[0], c[1], c[2]));
+            for (int k = 0; k < 3; ++k) {
+                spread(d.error[k + 1], at, d.stride, c[k] - chosen[k], d.atkinson);
+                cell[k] = chosen[k];
+            }
+        }
+    }
+}
+
+// Row y may run chunk c once row y - 1 has finished chunk c + 1, which the kernels read
+// back from. Every step runs all rows whose next chunk is ready, at kChunkLag chunks apart,
+// so a step's rows never touch the same error cells.
+void diffuse_wavefront(Diffusion& d, cv::Mat4b& cells) {
+    const int rows = cells.rows;
+    const int chunks = (cells.cols + kChunkColumns - 1) / kChunkColumns;
+    auto run_chunk = [&](int y, int chunk) {
+        const int first = chunk * kChunkColumns;
+        diffuse(d, cells.ptr<uchar>(y), y, first, std::min(first + kChunkColumns, cells.cols));
+    };
+    if (parallel_rows::threads() <= 1 || rows < 2) {
+        for (int y = 0; y < rows; ++y) {
+            for (int chunk = 0; chunk < chunks; ++chunk) {
+                run_chunk(y, chunk);
+            }
+        }
+        return;
+    }
+    const int steps = chunks + kChunkLag * (rows - 1);
+    for (int step = 0; step < steps; ++step) {
+        // Rows with step - kChunkLag * y inside [0, chunks).
+        const int last_row = std::min(rows - 1, step / kChunkLag);
+        const int first_row = step < chunks ? 0 : (step - chunks) / kChunkLag + 1;
+        const int active = last_row - first_row + 1;
+        parallel_rows::run(active, parallel_rows::band_count(active, 1), [&](int, int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const int y = first_row + i;
+                run_chunk(y, step - kChunkLag * y);
+            }
+        });
+    }
+}
+
+}  // namespace
+
+namespace dither {
+
+void apply(AsciiImage& image, DitherMode mode, const GlyphLut& lut, bool glyphs) {
+    const PaletteMode palette_mode = image.get_palette();
+    const bool colors = image.has_color() && palette_step(palette_mode) > 0;
+    if (mode == DitherMode::None || (!glyphs && !colors) || image.get_cells().empty()) {
+        return;
+    }
+    frame_trace::Scope scope("dither");
+    cv::Mat4b& cells = image.mutable_cells();
+    const Levels levels = levels_of(lut);
+
+    if (mode == DitherMode::Ordered) {
+        const std::vector<short> glyph_offsets = bayer_offsets(cells.cols, 256 / std::max(levels.count, 1));
+        const std::vector<short> color_offsets = bayer_offsets(cells.cols, palette_step(palette_mode));
+        const int bands = parallel_rows::band_count(cells.rows, kMinBandRows);
+        parallel_rows::run(cells.rows, bands, [&](int, int first_row, int end_row) {
+            for (int y = first_row; y < end_row; ++y) {
+                const size_t phase = static_cast<size_t>(y & 7) * cells.cols;
+                ordered_row(cells.ptr<uchar>(y), cells.cols, lut,
+                            glyphs ? glyph_offsets.data() + phase : nullptr,
+                            colors ? color_offsets.data() + phase : nullptr);
+            }
+        });
+        return;
+    }
+
+    Diffusion d{lut, levels, colors ? &Palette::get(palette_mode) : nullptr, glyphs,
+                mode == DitherMode::Atkinson, cells.cols + 2 * kPad, {}};
+    const size_t plane = static_cast<size_t>(cells.rows + 2) * d.stride;
+    d.error[0].assign(glyphs ? plane : 0, 0);
+    for (int k = 1; k < 4; ++k) {
+        d.error[k].assign(colors ? plane : 0, 0);
+    }
+    diffuse_wavefront(d, cells);
+}
+
+}  // namespace dither
@@ -0,0 +1,242 @@
+#include "effect_chain.hpp"
+#include "parallel_rows.hpp"
+#include "frame_trace.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr int kMinBandRows = 16;
+constexpr char kJunkGlyphs[] = "#$%&*+?!/\\|<>~=";
+constexpr uint32_t kJunkCount = sizeof(kJunkGlyphs) - 1;
+
+// Integer hash with good avalanche (lowbias32), cheap enough to run per cell.
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// Everything the row pass needs for one frame, worked out once before it starts.
+struct FrameParams {
+    int cols = 0;
+    int rows = 0;
+    int shift = 0;                 // chromatic shift in cells
+    int roll = 0;                  // source row offset
+    float brightness = 1;          // flicker
+    float vignette = 0;
+    uint32_t noise = 0;            // 0 to 255
+    uint32_t corruption = 0;       // out of 65536
+    uint32_t seed = 0;
+    std::vector<uint16_t> column_gain;  // vignette across the row, 256 is unchanged
+};
+
+// Scales colour by gain / 256, then adds noise centred on zero. Saturates at both ends.
+inline uchar shade(int v, int gain, int noise, int bias) {
+    return static_cast<uchar>(std::clamp(((v * gain) >> 8) + noise - bias, 0, 255));
+}
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+inline cv::v_uint8 shade(const cv::v_uint8& v, const cv::v_uint16& gain0, const cv::v_uint16& gain1,
+                         const cv::v_uint16& noise0, const cv::v_uint16& noise1, const cv::v_uint16& bias) {
+    cv::v_uint16 v0, v1;
+    cv::v_expand(v, v0, v1);
+    // 255 * 256 fits in 16 bits, the add and subtract saturate.
+    v0 = cv::v_sub(cv::v_add(cv::v_shr<8>(cv::v_mul_wrap(v0, gain0)), noise0), bias);
+    v1 = cv::v_sub(cv::v_add(cv::v_shr<8>(cv::v_mul_wrap(v1, gain1)), noise1), bias);
+    return cv::v_pack(v0, v1);
+}
+#endif
+
+// Scratch for one band, each row is unpacked into planes padded by the chromatic shift.
+struct RowPlanes {
+    explicit RowPlanes(const FrameParams& p)
+        : width(p.cols + 2 * p.shift), storage(4 * static_cast<size_t>(width)), gain(p.cols),
+          noise(p.cols, 0), junk(p.cols, 0) {
+        red = storage.data();
+        green = red + width;
+        blue = green + width;
+        glyph = blue + width;
+    }
+    int width;
+    std::vector<uchar> storage;
+    uchar* red;
+    uchar* green;
+    uchar* blue;
+    uchar* glyph;
+    std::vector<uint16_t> gain;
+    std::vector<uchar> noise;
+    std::vector<uchar> junk;   // replacement glyph, 0 keeps the cell's own
+};
+
+void unpack_row(const uchar* cells, RowPlanes& planes, int cols, int shift) {
+    uchar* red = planes.red + shift;
+    uchar* green = planes.green + shift;
+    uchar* blue = planes.blue + shift;
+    uchar* glyph = planes.glyph + shift;
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    for (; x <= cols - lanes; x += lanes) {
+        cv::v_uint8 r, g, b, c;
+        cv::v_load_deinterleave(cells + 4 * x, r, g, b, c);
+        cv::v_store(red + x, r);
+        cv::v_store(green + x, g);
+        cv::v_store(blue + x, b);
+        cv::v_store(glyph + x, c);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < cols; ++x) {
+        red[x] = cells[4 * x];
+        green[x] = cells[4 * x + 1];
+        blue[x] = cells[4 * x + 2];
+        glyph[x] = cells[4 * x + 3];
+    }
+    // Shifted channels repeat the edge cell instead of reading past the row.
+    if (shift > 0 && cols > 0) {
+        std::memset(planes.red, red[0], shift);
+        std::memset(red + cols, red[cols - 1], shift);
+        std::memset(planes.blue, blue[0], shift);
+        std::memset(blue + cols, blue[cols - 1], shift);
+    }
+}
+
+void effect_row(const FrameParams& p, RowPlanes& planes, int y, const uchar* source, uchar* out) {
+    const int cols = p.cols;
+    const int shift = p.shift;
+    unpack_row(source, planes, cols, shift);
+
+    const float dy = p.rows > 1 ? 2.0f * y / (p.rows - 1) - 1.0f : 0.0f;
+    const uint32_t row_gain = static_cast<uint32_t>(std::lround(256 * p.brightness * (1.0f - p.vignette * dy * dy)));
+    uint16_t* gain = planes.gain.data();
+    for (int x = 0; x < cols; ++x) {
+        gain[x] = static_cast<uint16_t>((p.column_gain[x] * row_gain) >> 8);
+    }
+    if (p.noise > 0 || p.corruption > 0) {
+        const uint32_t row_seed = hash32(p.seed + static_cast<uint32_t>(y));
+        uchar* noise = planes.noise.data();
+        uchar* junk = planes.junk.data();
+        for (int x = 0; x < cols; ++x) {
+            const uint32_t h = hash32(row_seed + static_cast<uint32_t>(x));
+            noise[x] = static_cast<uchar>(((h & 0xff) * p.noise) >> 8);
+            junk[x] = ((h >> 8) & 0xffff) < p.corruption ? kJunkGlyphs[(h >> 24) % kJunkCount] : 0;
+        }
+    }
+
+    // Red is drawn from shift cells to the left, blue from shift cells to the right.
+    const uchar* red = planes.red;
+    const uchar* green = planes.green + shift;
+    const uchar* blue = planes.blue + 2 * shift;
+    const uchar* glyph = planes.glyph + shift;
+    const uchar* noise = planes.noise.data();
+    const uchar* junk = planes.junk.data();
+    const int bias = static_cast<int>(p.noise / 2);
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const int half = cv::VTraits<cv::v_uint16>::vlanes();
+    const cv::v_uint16 bias_lanes = cv::vx_setall_u16(static_cast<ushort>(bias));
+    const cv::v_uint8 zero = cv::vx_setzero_u8();
+    for (; x <= cols - lanes; x += lanes) {
+        const cv::v_uint16 gain0 = cv::vx_load(gain + x);
+        const cv::v_uint16 gain1 = cv::vx_load(gain + x + half);
+        cv::v_uint16 noise0, noise1;
+        cv::v_expand(cv::vx_load(noise + x), noise0, noise1);
+        const cv::v_uint8 r = shade(cv::vx_load(red + x), gain0, gain1, noise0, noise1, bias_lanes);
+        const cv::v_uint8 g = shade(cv::vx_load(green + x), gain0, gain1, noise0, noise1, bias_lanes);
+        const cv::v_uint8 b = shade(cv::vx_load(blue + x), gain0, gain1, noise0, noise1, bias_lanes);
+        const cv::v_uint8 replacement = cv::vx_load(junk + x);
+        const cv::v_uint8 c = cv::v_select(cv::v_eq(replacement, zero), cv::vx_load(glyph + x), replacement);
+        cv::v_store_interleave(out + 4 * x, r, g, b, c);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < cols; ++x) {
+        uchar* cell = out + 4 * x;
+        cell[0] = shade(red[x], gain[x], noise[x], bias);
+        cell[1] = shade(green[x], gain[x], noise[x], bias);
+        cell[2] = shade(blue[x], gain[x], noise[x], bias);
+        cell[3] = junk[x] ? junk[x] : glyph[x];
+    }
+}
+
+}  // namespace
+
+EffectChain::EffectChain() {
+}
+
+EffectChain& EffectChain::add(EffectKind kind, float amount) {
+    effects_.push_back(Effect{kind, amount});
+    switch (kind) {
+        case EffectKind::Flicker:         fused_.flicker += amount; break;
+        case EffectKind::Noise:           fused_.noise += amount; break;
+        case EffectKind::Vignette:        fused_.vignette += amount; break;
+        case EffectKind::ChromaticShift:  fused_.shift += amount; break;
+        case EffectKind::ScanlineRoll:    fused_.roll += amount; break;
+        case EffectKind::GlyphCorruption: fused_.corruption += amount; break;
+    }
+    return *this;
+}
+
+void EffectChain::clear() {
+    effects_.clear();
+    fused_ = Fused();
+}
+
+bool EffectChain::empty() const {
+    return effects_.empty();
+}
+
+const std::vector<Effect>& EffectChain::effects() const {
+    return effects_;
+}
+
+void EffectChain::set_seed(uint64_t seed) {
+    seed_ = seed;
+}
+
+void EffectChain::apply(const AsciiImage& source, uint64_t frame, AsciiImage& out) const {
+    frame_trace::Scope scope("effects");
+    const cv::Mat4b& cells = source.get_cells();
+    FrameParams p;
+    p.cols = cells.cols;
+    p.rows = cells.rows;
+    p.seed = hash32(static_cast<uint32_t>(seed_ ^ (seed_ >> 32)) ^ hash32(static_cast<uint32_t>(frame)));
+    p.shift = std::clamp(static_cast<int>(std::lround(fused_.shift)), 0, std::max(p.cols - 1, 0));
+    const double rolled = std::floor(static_cast<double>(frame) * std::max(fused_.roll, 0.0f));
+    p.roll = p.rows > 0 ? static_cast<int>(static_cast<uint64_t>(rolled) % p.rows) : 0;
+    // Most frames barely dim, now and then one drops hard.
+    const float chance = hash32(p.seed) / 4294967296.0f;
+    p.brightness = std::clamp(1.0f - fused_.flicker * chance * chance * chance, 0.0f, 1.0f);
+    p.vignette = std::clamp(fused_.vignette, 0.0f, 1.0f);
+    p.noise = static_cast<uint32_t>(std::clamp(fused_.noise, 0.0f, 1.0f) * 255);
+    p.corruption = static_cast<uint32_t>(std::clamp(fused_.corruption, 0.0f, 1.0f) * 65536);
+    p.column_gain.resize(p.cols);
+    for (int x = 0; x < p.cols; ++x) {
+        const float dx = p.cols > 1 ? 2.0f * x / (p.cols - 1) - 1.0f : 0.0f;
+        p.column_gain[x] = static_cast<uint16_t>(std::lround(256 * (1.0f - p.vignette * dx * dx)));
+    }
+
+    // Every cell is written, so shared storage is replaced rather than copied.
+    const cv::Mat4b& current = out.get_cells();
+    if (out.is_shared() || current.cols != p.cols || current.rows != p.rows || current.data == cells.data) {
+        out = AsciiImage(AsciiImageData(cv::Mat4b(p.rows, p.cols), false));
+    }
+    out.set_greyscale(source.is_greyscale());
+    out.set_palette(source.get_palette());
+    cv::Mat4b& target = out.mutable_cells();
+
+    const int bands = parallel_rows::band_count(p.rows, kMinBandRows);
+    parallel_rows::run(p.rows, bands, [&](int, int first_row, int end_row) {
+        RowPlanes planes(p);
+        for (int y = first_row; y < end_row; ++y) {
+            effect_row(p, planes, y, cells.ptr<uchar>((y + p.roll) % p.rows), target.ptr<uchar>(y));
+        }
+    });
+}
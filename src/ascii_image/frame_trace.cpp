@@ -0,0 +1,205 @@
+#include "frame_trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace frame_trace {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+// Rings of exited threads kept for late exports, the oldest beyond this are released.
+constexpr size_t kMaxRetiredRings = 8;
+
+// Only the owning thread writes, readers take the same lock, so it is almost never contended.
+struct ThreadRing {
+    std::mutex mutex;
+    std::array<Event, kRingSize> events;
+    size_t next = 0;
+    size_t filled = 0;
+    uint32_t id = 0;
+    std::string name;
+    bool retired = false;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadRing>> rings;   // oldest first
+    uint32_t next_id = 1;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// A thread's name is kept here and its ring only made once it records with tracing enabled,
+// so threads that are merely named cost a string.
+struct ThreadState {
+    std::string name;
+    std::shared_ptr<ThreadRing> ring;
+
+    ~ThreadState() {
+        if (!ring) {
+            return;
+        }
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        ring->retired = true;
+        size_t retired = std::count_if(reg.rings.begin(), reg.rings.end(), [](const auto& r) { return r->retired; });
+        for (auto it = reg.rings.begin(); retired > kMaxRetiredRings && it != reg.rings.end();) {
+            if ((*it)->retired) {
+                it = reg.rings.erase(it);
+                retired--;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+};
+
+ThreadState& thread_state() {
+    thread_local ThreadState state;
+    return state;
+}
+
+ThreadRing& thread_ring() {
+    ThreadState& state = thread_state();
+    if (!state.ring) {
+        auto created = std::make_shared<ThreadRing>();
+        created->name = state.name;
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        created->id = reg.next_id++;
+        reg.rings.push_back(created);
+        state.ring = std::move(created);
+    }
+    return *state.ring;
+}
+
+std::vector<std::shared_ptr<ThreadRing>> all_rings() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.rings;
+}
+
+// Oldest first
+std::vector<Event> snapshot(ThreadRing& ring) {
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    std::vector<Event> events;
+    events.reserve(ring.filled);
+    const size_t first = (ring.next + kRingSize - ring.filled) % kRingSize;
+    for (size_t i = 0; i < ring.filled; ++i) {
+        events.push_back(ring.events[(first + i) % kRingSize]);
+    }
+    return events;
+}
+
+void write_escaped(std::ostream& out, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+}
+
+}  // namespace
+
+void set_enabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void set_thread_name(const std::string& name) {
+    ThreadState& state = thread_state();
+    state.name = name;
+    if (state.ring) {
+        std::lock_guard<std::mutex> lock(state.ring->mutex);
+        state.ring->name = name;
+    }
+}
+
+int64_t now_ns() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char* name, int64_t begin_ns, int64_t end_ns) {
+    ThreadRing& ring = thread_ring();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.next] = Event{name, begin_ns, end_ns};
+    ring.next = (ring.next + 1) % kRingSize;
+    ring.filled = std::min(ring.filled + 1, kRingSize);
+}
+
+std::vector<StageStats> stage_stats() {
+    std::map<std::string, std::vector<double>> durations;
+    for (const auto& ring : all_rings()) {
+        for (const Event& event : snapshot(*ring)) {
+            durations[event.name].push_back((event.end_ns - event.begin_ns) / 1e6);
+        }
+    }
+
+    std::vector<StageStats> result;
+    for (auto& [name, samples] : durations) {
+        StageStats stats;
+        stats.name = name;
+        stats.count = samples.size();
+        std::sort(samples.begin(), samples.end());
+        stats.p50_ms = samples[std::min(samples.size() - 1, samples.size() / 2)];
+        stats.p99_ms = samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99))];
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+
+bool write_chrome_trace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        return false;
+    }
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& ring : all_rings()) {
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            name = ring->name;
+        }
+        if (!name.empty()) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->id
+                << ",\"args\":{\"name\":\"";
+            write_escaped(out, name);
+            out << "\"}}";
+            first = false;
+        }
+        for (const Event& event : snapshot(*ring)) {
+            // Complete events, timestamps in microseconds
+            out << (first ? "" : ",\n") << "{\"name\":\"";
+            write_escaped(out, event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->id << ",\"ts\":" << event.begin_ns / 1000.0
+                << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+void clear() {
+    for (const auto& ring : all_rings()) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        ring->next = 0;
+        ring->filled = 0;
+    }
+}
+
+}  // namespace frame_trace
@@ -0,0 +1,145 @@
+#include <glyph_matcher.hpp>
+#include <glyph_atlas.hpp>
+#include <parallel_rows.hpp>
+#include <frame_trace.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr int kFlatContrast = 24;   // luma range below which a cell is drawn by brightness
+constexpr int kMinBandRows = 4;     // cell rows per band
+// Padded so any vector width divides it, the padding lanes are never compared.
+constexpr size_t kAtlasLanes = (kGlyphAtlas.size() + 15) / 16 * 16;
+
+// The atlas split into planes so a row of glyphs loads straight into vectors.
+struct AtlasPlanes {
+    alignas(64) uint64_t top[kAtlasLanes] = {};
+    alignas(64) uint64_t bottom[kAtlasLanes] = {};
+};
+
+const AtlasPlanes& atlas_planes() {
+    static const AtlasPlanes planes = [] {
+        AtlasPlanes result;
+        for (size_t i = 0; i < kGlyphAtlas.size(); ++i) {
+            result.top[i] = kGlyphAtlas[i].top;
+            result.bottom[i] = kGlyphAtlas[i].bottom;
+        }
+        return result;
+    }();
+    return planes;
+}
+
+// Sets bit (row % 8) * 8 + x of each cell word for every pixel of one row above its cell's threshold,
+// and folds the row into the per column min/max.
+void threshold_row(const uchar* luma, const uchar* thresholds, int width, int row,
+                   uint64_t* words, uchar* col_min, uchar* col_max) {
+    const int shift = (row % kGlyphCellHeight % 8) * 8;
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    using namespace cv;
+    const int lanes = VTraits<v_uint8>::vlanes();
+    const uint64_t lane_mask = lanes >= 64 ? ~uint64_t(0) : (uint64_t(1) << lanes) - 1;
+    for (; x + lanes <= width; x += lanes) {
+        const v_uint8 value = vx_load(luma + x);
+        v_store(col_min + x, v_min(vx_load(col_min + x), value));
+        v_store(col_max + x, v_max(vx_load(col_max + x), value));
+        // One bit per pixel, each byte of it is one cell's slice of the row.
+        const uint64_t bits = static_cast<uint64_t>(v_signmask(v_gt(value, vx_load(thresholds + x)))) & lane_mask;
+        for (int cell = 0; cell < lanes / kGlyphCellWidth; ++cell) {
+            words[x / kGlyphCellWidth + cell] |= ((bits >> (cell * kGlyphCellWidth)) & 0xFF) << shift;
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        col_min[x] = std::min(col_min[x], luma[x]);
+        col_max[x] = std::max(col_max[x], luma[x]);
+        if (luma[x] > thresholds[x]) {
+            words[x / kGlyphCellWidth] |= uint64_t(1) << (shift + x % kGlyphCellWidth);
+        }
+    }
+}
+
+}  // namespace
+
+namespace glyph_matcher {
+
+cv::Size detail_size(int columns, int rows) {
+    return cv::Size(columns * kGlyphCellWidth, rows * kGlyphCellHeight);
+}
+
+char best_glyph(uint64_t top, uint64_t bottom) {
+    const AtlasPlanes& planes = atlas_planes();
+    alignas(64) uint64_t distance[kAtlasLanes];
+    size_t i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    using namespace cv;
+    const int lanes = VTraits<v_uint64>::vlanes();
+    const v_uint64 cell_top = vx_setall_u64(top);
+    const v_uint64 cell_bottom = vx_setall_u64(bottom);
+    for (; i + lanes <= kAtlasLanes; i += lanes) {
+        v_store(distance + i, v_add(v_popcount(v_xor(cell_top, vx_load(planes.top + i))),
+                                    v_popcount(v_xor(cell_bottom, vx_load(planes.bottom + i)))));
+    }
+#endif
+    for (; i < kAtlasLanes; ++i) {
+        distance[i] = __builtin_popcountll(top ^ planes.top[i]) + __builtin_popcountll(bottom ^ planes.bottom[i]);
+    }
+    const uint64_t* best = std::min_element(distance, distance + kGlyphAtlas.size());
+    return kGlyphAtlas[best - distance].glyph;
+}
+
+cv::Mat4b match(const cv::Mat3b& detail, const GlyphLut& lut) {
+    frame_trace::Scope scope("glyph_match");
+    const int columns = detail.cols / kGlyphCellWidth;
+    const int rows = detail.rows / kGlyphCellHeight;
+    cv::Mat4b cells(rows, columns);
+    if (columns == 0 || rows == 0) {
+        return cells;
+    }
+
+    // Both are exact box averages at integer scale: the cell colour and the threshold for its mask.
+    cv::Mat3b colour;
+    cv::Mat1b luma;
+    cv::Mat1b mean;
+    cv::resize(detail, colour, cv::Size(columns, rows), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(detail, luma, cv::COLOR_RGB2GRAY);
+    cv::resize(luma, mean, cv::Size(columns, rows), 0, 0, cv::INTER_AREA);
+
+    const int width = columns * kGlyphCellWidth;
+    parallel_rows::run(rows, parallel_rows::band_count(rows, kMinBandRows), [&](int, int first, int end) {
+        std::vector<uchar> thresholds(width);
+        std::vector<uchar> col_min(width);
+        std::vector<uchar> col_max(width);
+        std::vector<uint64_t> top(columns);
+        std::vector<uint64_t> bottom(columns);
+        for (int row = first; row < end; ++row) {
+            const uchar* row_mean = mean.ptr<uchar>(row);
+            for (int x = 0; x < width; ++x) {
+                thresholds[x] = row_mean[x / kGlyphCellWidth];
+            }
+            std::fill(col_min.begin(), col_min.end(), 255);
+            std::fill(col_max.begin(), col_max.end(), 0);
+            std::fill(top.begin(), top.end(), 0);
+            std::fill(bottom.begin(), bottom.end(), 0);
+            for (int y = 0; y < kGlyphCellHeight; ++y) {
+                threshold_row(luma.ptr<uchar>(row * kGlyphCellHeight + y), thresholds.data(), width, y,
+                              y < 8 ? top.data() : bottom.data(), col_min.data(), col_max.data());
+            }
+
+            const cv::Vec3b* row_colour = colour.ptr<cv::Vec3b>(row);
+            cv::Vec4b* out = cells.ptr<cv::Vec4b>(row);
+            for (int col = 0; col < columns; ++col) {
+                const int x = col * kGlyphCellWidth;
+                const int low = *std::min_element(&col_min[x], &col_min[x] + kGlyphCellWidth);
+                const int high = *std::max_element(&col_max[x], &col_max[x] + kGlyphCellWidth);
+                const char glyph = high - low < kFlatContrast ? lut[row_mean[col]] : best_glyph(top[col], bottom[col]);
+                out[col] = cv::Vec4b(row_colour[col][0], row_colour[col][1], row_colour[col][2], static_cast<uchar>(glyph));
+            }
+        }
+    });
+    return cells;
+}
+
+}  // namespace glyph_matcher
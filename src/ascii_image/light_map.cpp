@@ -0,0 +1,474 @@
+#include "light_map.hpp"
+#include "parallel_rows.hpp"
+#include "frame_trace.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+namespace {
+
+constexpr int kMinBandRows = 16;
+// Past this many separate rectangles one bounding rectangle is cheaper to sum.
+constexpr size_t kMaxDirtyRects = 32;
+constexpr float kPi = 3.14159265f;
+// Share of a cone's half angle over which its edge fades out.
+constexpr float kConeEdge = 0.25f;
+
+// Integer hash with good avalanche (lowbias32), the same one the effect chain uses.
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// Adds rect to rects, merging it with any rectangle whose union wastes less than their overlap saves.
+void add_rect(std::vector<cv::Rect>& rects, cv::Rect rect) {
+    for (size_t i = 0; i < rects.size();) {
+        const cv::Rect merged = rects[i] | rect;
+        if (merged.area() <= rects[i].area() + rect.area()) {
+            rect = merged;
+            rects[i] = rects.back();
+            rects.pop_back();
+            i = 0;
+            continue;
+        }
+        ++i;
+    }
+    rects.push_back(rect);
+    if (rects.size() > kMaxDirtyRects) {
+        cv::Rect bounds = rects[0];
+        for (const cv::Rect& r : rects) {
+            bounds = bounds | r;
+        }
+        rects.assign(1, bounds);
+    }
+}
+
+// One light's field of view by recursive shadowcasting, octant by octant.
+struct Shadowcast {
+    const std::vector<uint8_t>& occluders;
+    cv::Size size;
+    int origin_x;
+    int origin_y;
+    int depth;
+    // Called for every cell the light reaches
+    std::function<void(int, int)> visit;
+
+    bool opaque(int x, int y) const {
+        return x >= 0 && y >= 0 && x < size.width && y < size.height &&
+               occluders[static_cast<size_t>(y) * size.width + x] != 0;
+    }
+
+    // Scans the rows of one octant between start and end slope, xx..yy map it onto the grid.
+    void scan(int row, float start, float end, int xx, int xy, int yx, int yy) const {
+        if (start < end) {
+            return;
+        }
+        float next_start = 0;
+        for (int j = row; j <= depth; ++j) {
+            bool blocked = false;
+            for (int dx = -j; dx <= 0; ++dx) {
+                const int dy = -j;
+                const float left = (dx - 0.5f) / (dy + 0.5f);
+                const float right = (dx + 0.5f) / (dy - 0.5f);
+                if (start < right) {
+                    continue;
+                }
+                if (end > left) {
+                    break;
+                }
+                const int x = origin_x + dx * xx + dy * xy;
+                const int y = origin_y + dx * yx + dy * yy;
+                visit(x, y);
+                if (blocked) {
+                    if (opaque(x, y)) {
+                        next_start = right;
+                        continue;
+                    }
+                    blocked = false;
+                    start = next_start;
+                }
+                else if (opaque(x, y) && j < depth) {
+                    // The wall is lit, the rows behind it only past its edges.
+                    blocked = true;
+                    scan(j + 1, start, left, xx, xy, yx, yy);
+                    next_start = right;
+                }
+            }
+            if (blocked) {
+                break;
+            }
+        }
+    }
+
+    void run() const {
+        static constexpr int kOctants[4][8] = {
+            {1, 0, 0, -1, -1, 0, 0, 1},
+            {0, 1, -1, 0, 0, -1, 1, 0},
+            {0, 1, 1, 0, 0, -1, -1, 0},
+            {1, 0, 0, 1, -1, 0, 0, -1},
+        };
+        visit(origin_x, origin_y);
+        for (int octant = 0; octant < 8; ++octant) {
+            scan(1, 1.0f, 0.0f, kOctants[0][octant], kOctants[1][octant], kOctants[2][octant], kOctants[3][octant]);
+        }
+    }
+};
+
+// levels += shape * gain / 256, saturating at full light.
+void add_scaled_row(uint8_t* levels, const uint8_t* shape, int count, int gain) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint16 gain_lanes = cv::vx_setall_u16(static_cast<ushort>(gain));
+    for (; x <= count - lanes; x += lanes) {
+        cv::v_uint16 s0, s1;
+        cv::v_expand(cv::vx_load(shape + x), s0, s1);
+        const cv::v_uint8 scaled = cv::v_pack(cv::v_shr<8>(cv::v_mul_wrap(s0, gain_lanes)),
+                                              cv::v_shr<8>(cv::v_mul_wrap(s1, gain_lanes)));
+        cv::v_store(levels + x, cv::v_add(cv::vx_load(levels + x), scaled));
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < count; ++x) {
+        levels[x] = static_cast<uint8_t>(std::min(levels[x] + ((shape[x] * gain) >> 8), 255));
+    }
+}
+
+// Scales the colours by the levels; with a lut the glyphs are picked again from the lit brightness.
+void light_row(const uchar* source, const uint8_t* levels, int count, const GlyphLut* lut, uchar* out) {
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+    const cv::v_uint16 wr = cv::vx_setall_u16(54);
+    const cv::v_uint16 wg = cv::vx_setall_u16(183);
+    const cv::v_uint16 wb = cv::vx_setall_u16(19);
+    const cv::v_uint16 round = cv::vx_setall_u16(128);
+    uchar level[cv::VTraits<cv::v_uint8>::max_nlanes];
+    uchar glyph[cv::VTraits<cv::v_uint8>::max_nlanes];
+    for (; x <= count - lanes; x += lanes) {
+        cv::v_uint8 r, g, b, c;
+        cv::v_load_deinterleave(source + 4 * x, r, g, b, c);
+        // 255 becomes 256, so full light leaves the colour as it was.
+        cv::v_uint16 l0, l1;
+        cv::v_expand(cv::vx_load(levels + x), l0, l1);
+        l0 = cv::v_add(l0, cv::v_shr<7>(l0));
+        l1 = cv::v_add(l1, cv::v_shr<7>(l1));
+        cv::v_uint16 r0, r1, g0, g1, b0, b1;
+        cv::v_expand(r, r0, r1);
+        cv::v_expand(g, g0, g1);
+        cv::v_expand(b, b0, b1);
+        r0 = cv::v_shr<8>(cv::v_mul_wrap(r0, l0));
+        r1 = cv::v_shr<8>(cv::v_mul_wrap(r1, l1));
+        g0 = cv::v_shr<8>(cv::v_mul_wrap(g0, l0));
+        g1 = cv::v_shr<8>(cv::v_mul_wrap(g1, l1));
+        b0 = cv::v_shr<8>(cv::v_mul_wrap(b0, l0));
+        b1 = cv::v_shr<8>(cv::v_mul_wrap(b1, l1));
+        if (lut) {
+            const cv::v_uint16 y0 = cv::v_shr<8>(cv::v_add(cv::v_add(cv::v_mul_wrap(r0, wr), cv::v_mul_wrap(g0, wg)),
+                                                           cv::v_add(cv::v_mul_wrap(b0, wb), round)));
+            const cv::v_uint16 y1 = cv::v_shr<8>(cv::v_add(cv::v_add(cv::v_mul_wrap(r1, wr), cv::v_mul_wrap(g1, wg)),
+                                                           cv::v_add(cv::v_mul_wrap(b1, wb), round)));
+            cv::v_store(level, cv::v_pack(y0, y1));
+            for (int i = 0; i < lanes; ++i) {
+                glyph[i] = static_cast<uchar>((*lut)[level[i]]);
+            }
+            c = cv::vx_load(glyph);
+        }
+        cv::v_store_interleave(out + 4 * x, cv::v_pack(r0, r1), cv::v_pack(g0, g1), cv::v_pack(b0, b1), c);
+    }
+    cv::vx_cleanup();
+#endif
+    for (; x < count; ++x) {
+        const uchar* cell = source + 4 * x;
+        const int light = levels[x] + (levels[x] >> 7);
+        const int r = (cell[0] * light) >> 8;
+        const int g = (cell[1] * light) >> 8;
+        const int b = (cell[2] * light) >> 8;
+        uchar* lit = out + 4 * x;
+        lit[0] = static_cast<uchar>(r);
+        lit[1] = static_cast<uchar>(g);
+        lit[2] = static_cast<uchar>(b);
+        lit[3] = lut ? static_cast<uchar>((*lut)[(54 * r + 183 * g + 19 * b + 128) >> 8]) : cell[3];
+    }
+}
+
+}  // namespace
+
+LightMap::LightMap() {
+}
+
+LightMap::LightMap(cv::Size size) {
+    resize(size);
+}
+
+void LightMap::resize(cv::Size size) {
+    size_ = cv::Size(std::max(0, size.width), std::max(0, size.height));
+    levels_.assign(static_cast<size_t>(size_.area()), ambient_);
+    occluders_.assign(static_cast<size_t>(size_.area()), 0);
+    dirty_.clear();
+    for (Slot& slot : slots_) {
+        slot.recast = true;
+        slot.area = cv::Rect();
+        slot.shape.clear();
+    }
+}
+
+cv::Size LightMap::size() const {
+    return size_;
+}
+
+void LightMap::set_ambient(uint8_t level) {
+    if (level == ambient_) {
+        return;
+    }
+    ambient_ = level;
+    mark(cv::Rect(0, 0, size_.width, size_.height));
+}
+
+void LightMap::set_cell_aspect(float aspect) {
+    if (aspect == cell_aspect_ || aspect <= 0) {
+        return;
+    }
+    cell_aspect_ = aspect;
+    for (Slot& slot : slots_) {
+        slot.recast = true;
+    }
+}
+
+void LightMap::set_occluders(const cv::Mat1b& occluders) {
+    if (occluders.cols != size_.width || occluders.rows != size_.height) {
+        std::cerr << "Error: Occluders are " << occluders.cols << "x" << occluders.rows << ", the light map is "
+                  << size_.width << "x" << size_.height << std::endl;
+        return;
+    }
+    // Only lights reaching the cells that changed see anything new.
+    cv::Rect changed;
+    for (int y = 0; y < size_.height; ++y) {
+        const uchar* row = occluders.ptr<uchar>(y);
+        uint8_t* current = occluders_.data() + static_cast<size_t>(y) * size_.width;
+        for (int x = 0; x < size_.width; ++x) {
+            const uint8_t opaque = row[x] != 0;
+            if (current[x] != opaque) {
+                current[x] = opaque;
+                changed = changed | cv::Rect(x, y, 1, 1);
+            }
+        }
+    }
+    for (Slot& slot : slots_) {
+        if (slot.alive && !(slot.area & changed).empty()) {
+            slot.recast = true;
+        }
+    }
+}
+
+void LightMap::set_occluder(cv::Point cell, bool opaque) {
+    if (cell.x < 0 || cell.y < 0 || cell.x >= size_.width || cell.y >= size_.height) {
+        return;
+    }
+    uint8_t& current = occluders_[static_cast<size_t>(cell.y) * size_.width + cell.x];
+    if (current == static_cast<uint8_t>(opaque)) {
+        return;
+    }
+    current = opaque;
+    for (Slot& slot : slots_) {
+        if (slot.alive && slot.area.contains(cell)) {
+            slot.recast = true;
+        }
+    }
+}
+
+LightMap::LightId LightMap::add_light(const Light& light) {
+    LightId id;
+    if (!free_ids_.empty()) {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+    }
+    else {
+        id = static_cast<LightId>(slots_.size());
+        slots_.emplace_back();
+    }
+    Slot& added = slots_[id];
+    added = Slot();
+    added.light = light;
+    added.alive = true;
+    return id;
+}
+
+void LightMap::remove_light(LightId id) {
+    Slot& removed = slots_[id];
+    if (!removed.alive) {
+        return;
+    }
+    mark(removed.area);
+    removed = Slot();
+    free_ids_.push_back(id);
+}
+
+void LightMap::set_light(LightId id, const Light& light) {
+    Slot& changed = slots_[id];
+    const Light& old = changed.light;
+    // Intensity and flicker only scale the contribution, anything else changes its shape.
+    if (light.position != old.position || light.radius != old.radius || light.direction != old.direction ||
+        light.spread != old.spread) {
+        changed.recast = true;
+    }
+    changed.light = light;
+}
+
+const Light& LightMap::light(LightId id) const {
+    return slots_[id].light;
+}
+
+bool LightMap::empty() const {
+    return free_ids_.size() == slots_.size();
+}
+
+void LightMap::cast(Slot& slot) const {
+    const Light& light = slot.light;
+    const float reach_x = std::max(light.radius, 0.0f);
+    const float reach_y = reach_x / cell_aspect_;
+    const int origin_x = static_cast<int>(std::floor(light.position.x));
+    const int origin_y = static_cast<int>(std::floor(light.position.y));
+    const int half_width = static_cast<int>(std::ceil(reach_x));
+    const int half_height = static_cast<int>(std::ceil(reach_y));
+    slot.area = cv::Rect(origin_x - half_width, origin_y - half_height, 2 * half_width + 1, 2 * half_height + 1) &
+                cv::Rect(0, 0, size_.width, size_.height);
+    slot.shape.assign(static_cast<size_t>(slot.area.area()), 0);
+    if (slot.area.empty() || reach_x <= 0) {
+        return;
+    }
+
+    const float radius_squared = reach_x * reach_x;
+    const bool cone = light.spread > 0 && light.spread < kPi;
+    const cv::Rect area = slot.area;
+    Shadowcast shadowcast{occluders_, size_, origin_x, origin_y, std::max(half_width, half_height), nullptr};
+    shadowcast.visit = [&](int x, int y) {
+        if (!area.contains(cv::Point(x, y))) {
+            return;
+        }
+        const float dx = x + 0.5f - light.position.x;
+        const float dy = (y + 0.5f - light.position.y) * cell_aspect_;
+        const float distance_squared = dx * dx + dy * dy;
+        if (distance_squared >= radius_squared) {
+            return;
+        }
+        // Smooth falloff to zero at the radius.
+        const float falloff = 1.0f - distance_squared / radius_squared;
+        float level = falloff * falloff;
+        if (cone && (x != origin_x || y != origin_y)) {
+            const float off_axis = std::abs(std::remainder(std::atan2(dy, dx) - light.direction, 2 * kPi));
+            if (off_axis >= light.spread) {
+                return;
+            }
+            level *= std::min(1.0f, (light.spread - off_axis) / (kConeEdge * light.spread));
+        }
+        uint8_t& cell = slot.shape[static_cast<size_t>(y - area.y) * area.width + (x - area.x)];
+        cell = std::max(cell, static_cast<uint8_t>(std::lround(255 * level)));
+    };
+    shadowcast.run();
+}
+
+void LightMap::mark(const cv::Rect& rect) {
+    const cv::Rect clipped = rect & cv::Rect(0, 0, size_.width, size_.height);
+    if (!clipped.empty()) {
+        add_rect(dirty_, clipped);
+    }
+}
+
+void LightMap::accumulate(const cv::Rect& rect) {
+    for (int y = rect.y; y < rect.y + rect.height; ++y) {
+        std::memset(levels_.data() + static_cast<size_t>(y) * size_.width + rect.x, ambient_, rect.width);
+    }
+    for (const Slot& slot : slots_) {
+        const cv::Rect overlap = slot.area & rect;
+        if (!slot.alive || slot.gain <= 0 || overlap.empty()) {
+            continue;
+        }
+        for (int y = overlap.y; y < overlap.y + overlap.height; ++y) {
+            const uint8_t* shape = slot.shape.data() + static_cast<size_t>(y - slot.area.y) * slot.area.width +
+                                   (overlap.x - slot.area.x);
+            add_scaled_row(levels_.data() + static_cast<size_t>(y) * size_.width + overlap.x, shape, overlap.width,
+                           slot.gain);
+        }
+    }
+}
+
+void LightMap::update(uint64_t frame) {
+    frame_trace::Scope scope("lighting");
+    recasts_ = 0;
+    const uint32_t seed = hash32(static_cast<uint32_t>(frame ^ (frame >> 32)));
+    for (size_t id = 0; id < slots_.size(); ++id) {
+        Slot& slot = slots_[id];
+        if (!slot.alive) {
+            continue;
+        }
+        // Same shape of flicker as the effect chain: mostly slight, now and then a deep dip.
+        const Light& light = slot.light;
+        const float chance = light.flicker > 0 ? hash32(seed ^ hash32(static_cast<uint32_t>(id) + 1)) / 4294967296.0f : 0;
+        const float intensity = std::clamp(light.intensity * (1.0f - light.flicker * chance * chance * chance), 0.0f, 1.0f);
+        const int gain = static_cast<int>(std::lround(256 * intensity));
+        if (slot.recast) {
+            mark(slot.area);
+            cast(slot);
+            mark(slot.area);
+            slot.recast = false;
+            recasts_++;
+        }
+        else if (gain != slot.gain) {
+            mark(slot.area);
+        }
+        slot.gain = gain;
+    }
+    for (const cv::Rect& rect : dirty_) {
+        accumulate(rect);
+    }
+    updated_.swap(dirty_);
+    dirty_.clear();
+}
+
+const std::vector<uint8_t>& LightMap::levels() const {
+    return levels_;
+}
+
+const std::vector<cv::Rect>& LightMap::updated_rects() const {
+    return updated_;
+}
+
+size_t LightMap::recast_count() const {
+    return recasts_;
+}
+
+void LightMap::apply(const AsciiImage& source, const GlyphLut& lut, AsciiImage& out, bool glyphs) const {
+    frame_trace::Scope scope("light_apply");
+    const cv::Mat4b& cells = source.get_cells();
+    const cv::Mat4b& current = out.get_cells();
+    if (out.is_shared() || current.cols != cells.cols || current.rows != cells.rows || current.data == cells.data) {
+        out = AsciiImage(AsciiImageData(cv::Mat4b(cells.rows, cells.cols), false));
+    }
+    out.set_greyscale(source.is_greyscale());
+    out.set_palette(source.get_palette());
+    cv::Mat4b& target = out.mutable_cells();
+
+    const int lit_columns = std::min(cells.cols, size_.width);
+    const int bands = parallel_rows::band_count(cells.rows, kMinBandRows);
+    parallel_rows::run(cells.rows, bands, [&](int, int first_row, int end_row) {
+        for (int y = first_row; y < end_row; ++y) {
+            const uchar* row = cells.ptr<uchar>(y);
+            uchar* lit = target.ptr<uchar>(y);
+            int x = 0;
+            if (y < size_.height) {
+                light_row(row, levels_.data() + static_cast<size_t>(y) * size_.width, lit_columns,
+                          glyphs ? &lut : nullptr, lit);
+                x = lit_columns;
+            }
+            std::memcpy(lit + 4 * x, row + 4 * x, 4 * static_cast<size_t>(cells.cols - x));
+        }
+    });
+}
@@ -0,0 +1,75 @@
+#include "palette.hpp"
+#include <cstdio>
+
+namespace {
+
+// xterm's default 16 colours
+constexpr uint8_t kAnsi16[16][3] = {
+    {0, 0, 0},       {205, 0, 0},     {0, 205, 0},     {205, 205, 0},
+    {0, 0, 238},     {205, 0, 205},   {0, 205, 205},   {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0},     {0, 255, 0},     {255, 255, 0},
+    {92, 92, 255},   {255, 0, 255},   {0, 255, 255},   {255, 255, 255},
+};
+constexpr uint8_t kCubeLevels[6] = {0, 95, 135, 175, 215, 255};
+
+int distance(const std::array<uint8_t, 3>& a, int r, int g, int b) {
+    // Green weighs most, roughly following perceived brightness.
+    const int dr = a[0] - r;
+    const int dg = a[1] - g;
+    const int db = a[2] - b;
+    return 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+}
+
+}  // namespace
+
+const Palette& Palette::get(PaletteMode mode) {
+    static const Palette ansi256(PaletteMode::Ansi256);
+    static const Palette ansi16(PaletteMode::Ansi16);
+    return mode == PaletteMode::Ansi16 ? ansi16 : ansi256;
+}
+
+Palette::Palette(PaletteMode mode) : mode_(mode) {
+    int first = 0;
+    int count = 16;
+    for (int i = 0; i < 16; ++i) {
+        colors_[i] = {kAnsi16[i][0], kAnsi16[i][1], kAnsi16[i][2]};
+    }
+    if (mode == PaletteMode::Ansi256) {
+        for (int i = 0; i < 216; ++i) {
+            colors_[16 + i] = {kCubeLevels[i / 36], kCubeLevels[i / 6 % 6], kCubeLevels[i % 6]};
+        }
+        for (int i = 0; i < 24; ++i) {
+            const uint8_t grey = static_cast<uint8_t>(8 + 10 * i);
+            colors_[232 + i] = {grey, grey, grey};
+        }
+        // The first 16 follow the terminal theme, only the fixed entries are matched against.
+        first = 16;
+        count = 256;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        PaletteCode& code = codes_[i];
+        const int length = mode == PaletteMode::Ansi256
+            ? std::snprintf(code.bytes, sizeof(code.bytes), "\033[38;5;%dm", i)
+            : std::snprintf(code.bytes, sizeof(code.bytes), "\033[%dm", i < 8 ? 30 + i : 90 + i - 8);
+        code.length = static_cast<uint8_t>(length);
+    }
+
+    // Nearest entry for the centre of every 8x8x8 bucket.
+    for (int r = 0; r < 32; ++r) {
+        for (int g = 0; g < 32; ++g) {
+            for (int b = 0; b < 32; ++b) {
+                int best = first;
+                int best_distance = distance(colors_[first], r * 8 + 4, g * 8 + 4, b * 8 + 4);
+                for (int i = first + 1; i < count; ++i) {
+                    const int d = distance(colors_[i], r * 8 + 4, g * 8 + 4, b * 8 + 4);
+                    if (d < best_distance) {
+                        best = i;
+                        best_distance = d;
+                    }
+                }
+                lut_[(r << 10) | (g << 5) | b] = static_cast<uint8_t>(best);
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#include "parallel_rows.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+
+namespace parallel_rows {
+
+namespace {
+
+std::atomic<int> configured_threads{0};
+
+}  // namespace
+
+void set_threads(int threads) {
+    configured_threads = std::max(threads, 0);
+    cv::setNumThreads(threads > 0 ? threads : -1);
+}
+
+int threads() {
+    const int configured = configured_threads;
+    return configured > 0 ? configured : std::max(cv::getNumThreads(), 1);
+}
+
+int band_count(int rows, int min_rows) {
+    return std::max(1, std::min(threads(), rows / std::max(min_rows, 1)));
+}
+
+void run(int rows, int bands, const std::function<void(int, int, int)>& body) {
+    if (bands <= 1) {
+        body(0, 0, rows);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int band = range.start; band < range.end; ++band) {
+            body(band, rows * band / bands, rows * (band + 1) / bands);
+        }
+    }, bands);
+}
+
+}  // namespace parallel_rows
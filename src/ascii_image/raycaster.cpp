@@ -0,0 +1,278 @@
+#include "raycaster.hpp"
+#include "parallel_rows.hpp"
+#include "frame_trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+constexpr int kMinBandColumns = 32;
+constexpr int kTextureCount = 10;
+const cv::Vec3b kPlainWall{190, 190, 190};
+
+// Same 8.8 Rec. 709 weights as the AsciiImage conversion.
+inline int luma(int r, int g, int b) {
+    return (54 * r + 183 * g + 19 * b + 128) >> 8;
+}
+
+// Light and fog at one distance, 8.8 fixed point.
+struct Shade {
+    int gain = 256;          // scales the colour, and so the glyph's brightness
+    int fog[3] = {0, 0, 0};  // fog colour times its share, added after gain
+};
+
+Shade shade_at(const RaySettings& settings, double distance, double light_scale) {
+    const double light = light_scale / (1.0 + settings.falloff * distance);
+    const double fog = 1.0 - std::exp(-settings.fog_density * distance);
+    Shade shade;
+    shade.gain = static_cast<int>(std::lround(256 * std::clamp(light * (1.0 - fog), 0.0, 1.0)));
+    for (int k = 0; k < 3; ++k) {
+        shade.fog[k] = static_cast<int>(std::lround(settings.fog[k] * std::clamp(fog, 0.0, 1.0)));
+    }
+    return shade;
+}
+
+inline cv::Vec4b shaded(const cv::Vec3b& color, const Shade& shade, const GlyphLut& lut) {
+    const int r = (color[0] * shade.gain) >> 8;
+    const int g = (color[1] * shade.gain) >> 8;
+    const int b = (color[2] * shade.gain) >> 8;
+    return cv::Vec4b(static_cast<uchar>(std::min(r + shade.fog[0], 255)),
+                     static_cast<uchar>(std::min(g + shade.fog[1], 255)),
+                     static_cast<uchar>(std::min(b + shade.fog[2], 255)),
+                     static_cast<uchar>(lut[luma(r, g, b)]));
+}
+
+}  // namespace
+
+struct Raycaster::View {
+    int cols = 0;
+    int rows = 0;
+    double dir_x = 0;
+    double dir_y = 0;
+    double plane_x = 0;
+    double plane_y = 0;
+    double scale = 0;     // cell rows one map cell high spans at distance 1
+    double horizon = 0;
+    std::vector<cv::Vec4b> backdrop;   // ceiling and floor, the same in every column
+};
+
+Raycaster::Raycaster() : lut_(ColorUtils::glyph_lut()) {
+    textures_.resize(kTextureCount);
+}
+
+bool Raycaster::set_map(const std::vector<std::string>& rows) {
+    if (rows.empty() || rows.front().empty()) {
+        std::cerr << "Error: Empty raycaster map" << std::endl;
+        return false;
+    }
+    const size_t width = rows.front().size();
+    std::vector<uint8_t> map;
+    map.reserve(width * rows.size());
+    for (const std::string& row : rows) {
+        if (row.size() != width) {
+            std::cerr << "Error: Raycaster map rows differ in length" << std::endl;
+            return false;
+        }
+        for (char c : row) {
+            if (c == ' ' || c == '.') {
+                map.push_back(0);
+            }
+            else if (c >= '1' && c <= '9') {
+                map.push_back(static_cast<uint8_t>(c - '0'));
+            }
+            else {
+                map.push_back(1);
+            }
+        }
+    }
+    map_ = std::move(map);
+    map_width_ = static_cast<int>(width);
+    map_height_ = static_cast<int>(rows.size());
+    revision_++;
+    return true;
+}
+
+bool Raycaster::has_map() const {
+    return !map_.empty();
+}
+
+cv::Size Raycaster::map_size() const {
+    return cv::Size(map_width_, map_height_);
+}
+
+uint8_t Raycaster::tile(int x, int y) const {
+    if (x < 0 || y < 0 || x >= map_width_ || y >= map_height_) {
+        return 0;
+    }
+    return map_[static_cast<size_t>(y) * map_width_ + x];
+}
+
+void Raycaster::set_texture(uint8_t texture, const AsciiImage& image) {
+    if (texture == 0 || texture >= kTextureCount) {
+        std::cerr << "Error: Raycaster texture " << static_cast<int>(texture) << " out of range" << std::endl;
+        return;
+    }
+    const cv::Mat4b& cells = image.get_cells();
+    Texture& target = textures_[texture];
+    target.width = cells.cols;
+    target.height = cells.rows;
+    target.texels.resize(static_cast<size_t>(cells.cols) * cells.rows);
+    for (int y = 0; y < cells.rows; ++y) {
+        const uchar* cell = cells.ptr<uchar>(y);
+        for (int x = 0; x < cells.cols; ++x, cell += 4) {
+            target.texels[static_cast<size_t>(x) * cells.rows + y] = cv::Vec3b(cell[0], cell[1], cell[2]);
+        }
+    }
+    revision_++;
+}
+
+void Raycaster::set_camera(const RayCamera& camera) {
+    camera_ = camera;
+    revision_++;
+}
+
+const RayCamera& Raycaster::camera() const {
+    return camera_;
+}
+
+void Raycaster::set_settings(const RaySettings& settings) {
+    settings_ = settings;
+    revision_++;
+}
+
+const RaySettings& Raycaster::settings() const {
+    return settings_;
+}
+
+void Raycaster::set_lut(const GlyphLut& lut) {
+    lut_ = lut;
+    revision_++;
+}
+
+const GlyphLut& Raycaster::lut() const {
+    return lut_;
+}
+
+uint64_t Raycaster::revision() const {
+    return revision_;
+}
+
+void Raycaster::draw_column(const View& view, int x, cv::Vec4b* column) const {
+    const double camera_x = 2.0 * (x + 0.5) / view.cols - 1.0;
+    const double ray_x = view.dir_x + view.plane_x * camera_x;
+    const double ray_y = view.dir_y + view.plane_y * camera_x;
+    int map_x = static_cast<int>(std::floor(camera_.x));
+    int map_y = static_cast<int>(std::floor(camera_.y));
+    const double delta_x = ray_x == 0 ? 1e30 : std::abs(1.0 / ray_x);
+    const double delta_y = ray_y == 0 ? 1e30 : std::abs(1.0 / ray_y);
+    const int step_x = ray_x < 0 ? -1 : 1;
+    const int step_y = ray_y < 0 ? -1 : 1;
+    double side_x = (ray_x < 0 ? camera_.x - map_x : map_x + 1.0 - camera_.x) * delta_x;
+    double side_y = (ray_y < 0 ? camera_.y - map_y : map_y + 1.0 - camera_.y) * delta_y;
+
+    // Distance is along the view direction, not the ray, so walls don't bulge at the edges.
+    uint8_t hit = 0;
+    bool y_side = false;
+    double distance = 0;
+    while (true) {
+        if (side_x < side_y) {
+            distance = side_x;
+            side_x += delta_x;
+            map_x += step_x;
+            y_side = false;
+        }
+        else {
+            distance = side_y;
+            side_y += delta_y;
+            map_y += step_y;
+            y_side = true;
+        }
+        // Past the edge and heading away, nothing is left to hit.
+        if (distance > settings_.max_distance || (map_x < 0 && step_x < 0) || (map_x >= map_width_ && step_x > 0) ||
+            (map_y < 0 && step_y < 0) || (map_y >= map_height_ && step_y > 0)) {
+            break;
+        }
+        hit = tile(map_x, map_y);
+        if (hit) {
+            break;
+        }
+    }
+    if (!hit) {
+        std::copy(view.backdrop.begin(), view.backdrop.end(), column);
+        return;
+    }
+
+    const double line = view.scale / std::max(distance, 1e-6);
+    const double top = view.horizon - line / 2;
+    const int first = std::clamp(static_cast<int>(std::ceil(top - 0.5)), 0, view.rows);
+    const int end = std::clamp(static_cast<int>(std::ceil(top + line - 0.5)), first, view.rows);
+    std::copy(view.backdrop.begin(), view.backdrop.begin() + first, column);
+    std::copy(view.backdrop.begin() + end, view.backdrop.end(), column + end);
+
+    const Shade shade = shade_at(settings_, distance, y_side ? settings_.side_shade : 1.0);
+    const Texture& texture = textures_[hit];
+    if (texture.texels.empty()) {
+        std::fill(column + first, column + end, shaded(kPlainWall, shade, lut_));
+        return;
+    }
+    double wall = y_side ? camera_.x + distance * ray_x : camera_.y + distance * ray_y;
+    wall -= std::floor(wall);
+    int u = std::min(static_cast<int>(wall * texture.width), texture.width - 1);
+    // Mirrored on the faces seen from the other side, so textures read the same way round.
+    if ((!y_side && ray_x > 0) || (y_side && ray_y < 0)) {
+        u = texture.width - 1 - u;
+    }
+    const cv::Vec3b* texels = texture.texels.data() + static_cast<size_t>(u) * texture.height;
+    // Texture row in 16.16 fixed point, stepping once per cell row.
+    const double step = texture.height / line;
+    uint32_t v = static_cast<uint32_t>(std::max((first + 0.5 - top) * step, 0.0) * 65536);
+    const uint32_t v_step = static_cast<uint32_t>(step * 65536);
+    const int last = texture.height - 1;
+    for (int y = first; y < end; ++y, v += v_step) {
+        column[y] = shaded(texels[std::min(static_cast<int>(v >> 16), last)], shade, lut_);
+    }
+}
+
+void Raycaster::render(cv::Size size, AsciiImage& out) const {
+    frame_trace::Scope scope("raycast");
+    const int cols = std::max(size.width, 0);
+    const int rows = std::max(size.height, 0);
+    const cv::Mat4b& current = out.get_cells();
+    if (out.is_shared() || current.cols != cols || current.rows != rows) {
+        out = AsciiImage(AsciiImageData(cv::Mat4b(rows, cols), false));
+    }
+    out.set_greyscale(false);
+    if (cols == 0 || rows == 0) {
+        return;
+    }
+
+    View view;
+    view.cols = cols;
+    view.rows = rows;
+    const double plane = std::tan(camera_.fov / 2);
+    view.dir_x = std::cos(camera_.angle);
+    view.dir_y = std::sin(camera_.angle);
+    view.plane_x = -view.dir_y * plane;
+    view.plane_y = view.dir_x * plane;
+    view.scale = cols / (2 * plane * settings_.cell_aspect);
+    view.horizon = rows / 2.0;
+    // A row of floor shows the plane half a cell below the eye at one distance, the ceiling likewise above it.
+    view.backdrop.resize(rows);
+    for (int y = 0; y < rows; ++y) {
+        const double offset = std::abs(y + 0.5 - view.horizon);
+        const double distance = std::min(0.5 * view.scale / std::max(offset, 1e-6), double(settings_.max_distance));
+        const bool floor = y + 0.5 > view.horizon;
+        view.backdrop[y] = shaded(floor ? settings_.floor : settings_.ceiling, shade_at(settings_, distance, 1.0), lut_);
+    }
+
+    // One row per screen column, drawn top to bottom.
+    cv::Mat4b columns(cols, rows);
+    const int bands = parallel_rows::band_count(cols, kMinBandColumns);
+    parallel_rows::run(cols, bands, [&](int, int first_column, int end_column) {
+        for (int x = first_column; x < end_column; ++x) {
+            draw_column(view, x, columns.ptr<cv::Vec4b>(x));
+        }
+    });
+    cv::transpose(columns, out.mutable_cells());
+}
@@ -0,0 +1,161 @@
+#include "terminal_renderer.hpp"
+#include "ansi_encoding.hpp"
+#include "frame_trace.hpp"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace ansi_encoding;
+
+namespace {
+
+constexpr char kSyncBegin[] = "\033[?2026h";
+constexpr char kSyncEnd[] = "\033[?2026l";
+// Unchanged cells shorter than this between two changed runs are rewritten
+// rather than paying for another cursor jump.
+constexpr int kMergeGap = 6;
+inline uint32_t load_cell(const uchar* cell) {
+    uint32_t packed;
+    std::memcpy(&packed, cell, 4);
+    return packed;
+}
+
+// What the terminal ends up showing for a cell: colour changes that map to the same
+// palette entry, or any colour change without colour output, don't need a redraw.
+inline uint32_t cell_key(const uchar* cell, bool color, const Palette* palette) {
+    if (!color) {
+        return cell[3];
+    }
+    if (palette) {
+        return (uint32_t(palette->index(cell[0], cell[1], cell[2])) << 8) | cell[3];
+    }
+    return load_cell(cell);
+}
+
+}  // namespace
+
+TerminalRenderer::TerminalRenderer(int fd) : fd_(fd) {
+}
+
+TerminalRenderer::~TerminalRenderer() {
+    if (began_) {
+        const char restore[] = "\033[0m\033[?25h\n";
+        flush(restore, sizeof(restore) - 1);
+    }
+}
+
+void TerminalRenderer::begin() {
+    const char setup[] = "\033[?25l\033[H\033[2J";
+    flush(setup, sizeof(setup) - 1);
+    began_ = true;
+    invalidate();
+}
+
+void TerminalRenderer::invalidate() {
+    valid_ = false;
+}
+
+size_t TerminalRenderer::last_frame_bytes() const {
+    return last_frame_bytes_;
+}
+
+bool TerminalRenderer::present(const AsciiImage& image) {
+    frame_trace::Scope scope("terminal_present");
+    const cv::Mat4b& cells = image.get_cells();
+    const bool color = image.has_color();
+    const PaletteMode mode = color ? image.get_palette() : PaletteMode::Mono;
+    const Palette* palette = color && mode != PaletteMode::TrueColor ? &Palette::get(mode) : nullptr;
+    const int rows = cells.rows;
+    const int cols = cells.cols;
+
+    // Keys from another mode aren't comparable, so a mode switch redraws everything.
+    const bool full = !valid_ || rows != rows_ || cols != cols_ || mode != mode_;
+    if (full) {
+        previous_.assign(static_cast<size_t>(rows) * cols, 0);
+        rows_ = rows;
+        cols_ = cols;
+        mode_ = mode;
+    }
+
+    const size_t worst_case = static_cast<size_t>(rows) * cols * (kMaxCellBytes + kMaxCursorBytes) + 64;
+    if (buffer_.size() < worst_case) {
+        buffer_.resize(worst_case);
+    }
+    char* const begin = buffer_.data();
+    char* out = put_literal(begin, kSyncBegin, sizeof(kSyncBegin) - 1);
+    if (full) {
+        out = put_literal(out, "\033[0m\033[2J", 8);
+    }
+
+    long current_color = -1;
+    for (int y = 0; y < rows; ++y) {
+        const uchar* row = cells.ptr<uchar>(y);
+        uint32_t* prev = previous_.data() + static_cast<size_t>(y) * cols;
+        int x = 0;
+        while (x < cols) {
+            // Find the next changed cell.
+            while (x < cols && !full && cell_key(row + 4 * x, color, palette) == prev[x]) {
+                ++x;
+            }
+            if (x >= cols) {
+                break;
+            }
+            // Extend the run, swallowing short unchanged gaps.
+            int end = x + 1;
+            int last_changed = x;
+            while (end < cols && end - last_changed <= kMergeGap) {
+                if (full || cell_key(row + 4 * end, color, palette) != prev[end]) {
+                    last_changed = end;
+                }
+                ++end;
+            }
+            end = last_changed + 1;
+
+            out = put_cursor(out, y, x);
+            for (; x < end; ++x) {
+                const uchar* cell = row + 4 * x;
+                if (palette) {
+                    const uint8_t index = palette->index(cell[0], cell[1], cell[2]);
+                    if (index != current_color) {
+                        out = put_code(out, palette->code(index));
+                        current_color = index;
+                    }
+                }
+                else if (color) {
+                    const long rgb = (long(cell[0]) << 16) | (long(cell[1]) << 8) | cell[2];
+                    if (rgb != current_color) {
+                        out = put_rgb(out, cell[0], cell[1], cell[2]);
+                        current_color = rgb;
+                    }
+                }
+                *out++ = static_cast<char>(cell[3]);
+                prev[x] = cell_key(cell, color, palette);
+            }
+        }
+    }
+    if (current_color != -1) {
+        out = put_reset(out);
+    }
+    out = put_literal(out, kSyncEnd, sizeof(kSyncEnd) - 1);
+
+    valid_ = true;
+    last_frame_bytes_ = out - begin;
+    return flush(begin, last_frame_bytes_);
+}
+
+bool TerminalRenderer::flush(const char* data, size_t size) {
+    frame_trace::Scope scope("terminal_flush");
+    // One write per frame, only looping if the kernel accepts it partially.
+    while (size > 0) {
+        const ssize_t written = ::write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
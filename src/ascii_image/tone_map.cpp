@@ -0,0 +1,131 @@
+#include "tone_map.hpp"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// Share of pixels clipped at each end by auto exposure.
+constexpr float kClipFraction = 0.01f;
+// Exposure never stretches less than this range, so flat frames don't turn into noise.
+constexpr float kMinRange = 32;
+
+}  // namespace
+
+namespace tone_map {
+
+const GlyphLut& ramp_lut(const ToneSettings& settings) {
+    const int contrast = std::clamp(settings.contrast, kMinContrast, kMaxContrast);
+    switch (settings.ramp) {
+    case Ramp::Full:
+        return kRampLuts[0][contrast - kMinContrast];
+    case Ramp::Short:
+        return kRampLuts[1][contrast - kMinContrast];
+    case Ramp::Dim:
+        return kRampLuts[2][contrast - kMinContrast];
+    case Ramp::Custom:
+        break;
+    }
+    if (settings.custom_ramp.empty()) {
+        return kRampLuts[0][contrast - kMinContrast];
+    }
+
+    // Entries are never erased, so references stay valid after the lock is released.
+    static std::mutex mutex;
+    static std::unordered_map<std::string, GlyphLut> custom;
+    const std::string key = std::to_string(contrast) + ':' + settings.custom_ramp;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = custom.find(key);
+    if (it == custom.end()) {
+        it = custom.emplace(key, make_ramp_lut(settings.custom_ramp, contrast)).first;
+    }
+    return it->second;
+}
+
+}  // namespace tone_map
+
+ToneMapper::ToneMapper() {
+    rebuild();
+}
+
+void ToneMapper::set_settings(const ToneSettings& settings) {
+    settings_ = settings;
+    if (!settings_.auto_exposure) {
+        black_ = 0;
+        white_ = 255;
+        exposed_ = false;
+    }
+    built_black_ = -1;
+    rebuild();
+}
+
+const ToneSettings& ToneMapper::settings() const {
+    return settings_;
+}
+
+const GlyphLut& ToneMapper::lut() const {
+    return lut_;
+}
+
+void ToneMapper::reset_exposure() {
+    exposed_ = false;
+}
+
+void ToneMapper::observe(const cv::Mat3b& rgb) {
+    if (!settings_.auto_exposure || rgb.empty()) {
+        return;
+    }
+    cv::Mat1b luma;
+    cv::cvtColor(rgb, luma, cv::COLOR_RGB2GRAY);
+    std::array<int, 256> histogram{};
+    for (int y = 0; y < luma.rows; ++y) {
+        const uchar* row = luma.ptr<uchar>(y);
+        for (int x = 0; x < luma.cols; ++x) {
+            histogram[row[x]]++;
+        }
+    }
+
+    const int clipped = static_cast<int>(luma.total() * kClipFraction);
+    int low = 0;
+    for (int seen = 0; low < 255 && seen + histogram[low] <= clipped; ++low) {
+        seen += histogram[low];
+    }
+    int high = 255;
+    for (int seen = 0; high > low && seen + histogram[high] <= clipped; --high) {
+        seen += histogram[high];
+    }
+    float target_black = static_cast<float>(low);
+    float target_white = static_cast<float>(high);
+    if (target_white - target_black < kMinRange) {
+        const float middle = (target_black + target_white) / 2;
+        target_black = std::max(0.0f, middle - kMinRange / 2);
+        target_white = std::min(255.0f, target_black + kMinRange);
+    }
+
+    // Exponential moving average so the exposure drifts instead of pumping between frames.
+    const float alpha = exposed_ ? std::clamp(settings_.exposure_smoothing, 0.0f, 1.0f) : 1.0f;
+    black_ += alpha * (target_black - black_);
+    white_ += alpha * (target_white - white_);
+    exposed_ = true;
+    rebuild();
+}
+
+void ToneMapper::rebuild() {
+    const int black = static_cast<int>(std::lround(black_));
+    const int white = static_cast<int>(std::lround(white_));
+    if (black == built_black_ && white == built_white_) {
+        return;
+    }
+    built_black_ = black;
+    built_white_ = white;
+
+    const GlyphLut& ramp = tone_map::ramp_lut(settings_);
+    const float gamma = settings_.gamma > 0 ? settings_.gamma : 1.0f;
+    const float range = static_cast<float>(std::max(1, white - black));
+    for (int brightness = 0; brightness < 256; ++brightness) {
+        const float level = std::clamp((brightness - black) / range, 0.0f, 1.0f);
+        const int mapped = static_cast<int>(std::lround(std::pow(level, 1.0f / gamma) * 255));
+        lut_[brightness] = ramp[mapped];
+    }
+}
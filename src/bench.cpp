@@ -0,0 +1,249 @@
+#include "ascii_image.hpp"
+#include "ansi_text.hpp"
+#include "ansi_paragraph.hpp"
+#include "ascii_image_node.hpp"
+#include "ftxui/dom/elements.hpp"
+#include "ftxui/dom/node.hpp"
+#include "ftxui/screen/screen.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Times every stage from image file to terminal bytes separately, on each image and
+// output size, and writes the results as JSON for comparing builds.
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+// Counts bytes without storing them, so operator<< is measured without a growing string.
+class CountingBuffer : public std::streambuf {
+public:
+    size_t bytes = 0;
+protected:
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        bytes += static_cast<size_t>(count);
+        return count;
+    }
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            bytes++;
+        }
+        return c;
+    }
+};
+
+struct StageResult {
+    std::string name;
+    double ns = 0;              // median per run
+    double ns_per_cell = 0;
+    double allocations = 0;     // per run
+    size_t bytes = 0;           // emitted by the stage, 0 where it doesn't write
+};
+
+struct CaseResult {
+    std::string image;
+    int width = 0;
+    int height = 0;
+    int cells = 0;
+    std::vector<StageResult> stages;
+};
+
+// Runs body until min_time has passed (at least min_runs times) and keeps the median.
+StageResult measure(const std::string& name, int cells, int min_runs, const std::function<size_t()>& body) {
+    using Clock = std::chrono::steady_clock;
+    const auto min_time = std::chrono::milliseconds(200);
+    std::vector<double> samples;
+    size_t bytes = 0;
+    size_t stage_allocations = 0;
+    const Clock::time_point start = Clock::now();
+    while (static_cast<int>(samples.size()) < min_runs || Clock::now() - start < min_time) {
+        // Only the body's allocations count, not growing samples.
+        const size_t allocations_before = allocations;
+        const Clock::time_point run_start = Clock::now();
+        bytes = body();
+        const Clock::time_point run_end = Clock::now();
+        stage_allocations += allocations - allocations_before;
+        samples.push_back(std::chrono::duration<double, std::nano>(run_end - run_start).count());
+    }
+
+    StageResult result;
+    result.name = name;
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    result.ns = samples[samples.size() / 2];
+    result.ns_per_cell = cells > 0 ? result.ns / cells : 0;
+    result.allocations = static_cast<double>(stage_allocations) / samples.size();
+    result.bytes = bytes;
+    return result;
+}
+
+CaseResult run_case(const std::string& path, const cv::Mat& source, int width, int height, int min_runs) {
+    CaseResult result;
+    result.image = path;
+    result.width = width;
+    result.height = height;
+
+    cv::Mat3b rgb;
+    {
+        cv::Mat resized;
+        cv::resize(source, resized, cv::Size(width, height), 0, 0, cv::INTER_LANCZOS4);
+        cv::cvtColor(resized, rgb, cv::COLOR_BGR2RGB);
+    }
+    AsciiImage image(rgb);
+    result.cells = image.get_cells().cols * image.get_cells().rows;
+    std::ostringstream encoded;
+    encoded << image;
+    const std::string ansi = encoded.str();
+    const int cols = image.get_cells().cols;
+    const int rows = image.get_cells().rows;
+    const int cells = result.cells;
+
+    result.stages.push_back(measure("imread", cells, min_runs, [&] {
+        const cv::Mat decoded = cv::imread(path);
+        return size_t(0);
+    }));
+    result.stages.push_back(measure("resize", cells, min_runs, [&] {
+        cv::Mat resized;
+        cv::Mat3b converted;
+        cv::resize(source, resized, cv::Size(width, height), 0, 0, cv::INTER_LANCZOS4);
+        cv::cvtColor(resized, converted, cv::COLOR_BGR2RGB);
+        return size_t(0);
+    }));
+    result.stages.push_back(measure("ascii_image", cells, min_runs, [&] {
+        AsciiImage converted(rgb);
+        return size_t(0);
+    }));
+    result.stages.push_back(measure("serialize", cells, min_runs, [&] {
+        CountingBuffer counter;
+        std::ostream out(&counter);
+        out << image;
+        return counter.bytes;
+    }));
+    result.stages.push_back(measure("ansi_text", cells, min_runs, [&] {
+        ftxui::AnsiText text(ansi);
+        return size_t(0);
+    }));
+    result.stages.push_back(measure("paragraph_layout", cells, min_runs, [&] {
+        ftxui::Element paragraph = ftxui::ansi_paragraph(ansi);
+        paragraph->ComputeRequirement();
+        paragraph->SetBox(ftxui::Box{0, cols - 1, 0, rows - 1});
+        return size_t(0);
+    }));
+    result.stages.push_back(measure("screen_render", cells, min_runs, [&] {
+        ftxui::Screen screen = ftxui::Screen::Create(ftxui::Dimension::Fixed(cols), ftxui::Dimension::Fixed(rows));
+        ftxui::Render(screen, ftxui::ascii_image(image));
+        return screen.ToString().size();
+    }));
+    return result;
+}
+
+void write_json(std::ostream& out, const std::vector<CaseResult>& results) {
+    out << "{\n  \"cases\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const CaseResult& c = results[i];
+        out << "    {\"image\": \"" << c.image << "\", \"width\": " << c.width << ", \"height\": " << c.height
+            << ", \"cells\": " << c.cells << ", \"stages\": [\n";
+        for (size_t j = 0; j < c.stages.size(); ++j) {
+            const StageResult& s = c.stages[j];
+            out << "      {\"name\": \"" << s.name << "\", \"ns\": " << s.ns << ", \"ns_per_cell\": " << s.ns_per_cell
+                << ", \"allocations\": " << s.allocations << ", \"bytes\": " << s.bytes << "}"
+                << (j + 1 < c.stages.size() ? "," : "") << "\n";
+        }
+        out << "    ]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [--json file] [--runs n] [images...]" << std::endl;
+    std::cout << "  --json: Where to write the results (default: bench.json)" << std::endl;
+    std::cout << "  --runs: Minimum runs per stage (default: 5)" << std::endl;
+    std::cout << "  images: Images to convert (default: images/boat.jpg images/tree.jpg)" << std::endl;
+}
+
+}  // namespace
+
+// Every allocation in the process is counted, including those on worker threads.
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char* argv[]) {
+    std::string json_path = "bench.json";
+    int min_runs = 5;
+    std::vector<std::string> images;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        }
+        else if (arg == "--runs" && i + 1 < argc) {
+            min_runs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else {
+            images.push_back(arg);
+        }
+    }
+    if (images.empty()) {
+        images = {"images/boat.jpg", "images/tree.jpg"};
+    }
+
+    // Image widths before the 3x horizontal stretch, heights follow the aspect ratio.
+    const int widths[] = {40, 80, 160};
+    std::vector<CaseResult> results;
+    for (const std::string& path : images) {
+        const cv::Mat source = cv::imread(path);
+        if (source.empty()) {
+            std::cerr << "Error: Could not load image " << path << std::endl;
+            return 1;
+        }
+        for (int width : widths) {
+            const int height = std::max(1, cvRound(width * AsciiImage::default_horizontal_scale * source.rows / (2.0 * source.cols)));
+            results.push_back(run_case(path, source, width, height, min_runs));
+
+            const CaseResult& c = results.back();
+            std::cout << c.image << " " << c.width << "x" << c.height << " (" << c.cells << " cells)" << std::endl;
+            for (const StageResult& s : c.stages) {
+                std::cout << "  " << s.name << ": " << s.ns / 1000 << " us, " << s.ns_per_cell << " ns/cell, "
+                          << s.allocations << " allocs";
+                if (s.bytes > 0) {
+                    std::cout << ", " << s.bytes << " bytes";
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+
+    std::ofstream json(json_path);
+    if (!json) {
+        std::cerr << "Error: Could not write " << json_path << std::endl;
+        return 1;
+    }
+    write_json(json, results);
+    std::cout << "Wrote " << json_path << std::endl;
+    return 0;
+}
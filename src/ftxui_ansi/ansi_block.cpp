@@ -0,0 +1,211 @@
+#include "ansi_block.hpp"
+#include <algorithm>
+
+namespace ftxui {
+
+namespace {
+
+// Documents kept per thread, enough for every panel of the HUD and a few spares.
+constexpr size_t kCachedDocuments = 16;
+
+}  // namespace
+
+AnsiDocument::AnsiDocument(const std::string& text) : text_(text) {
+    AnsiParseResult parsed = ParseAnsi(text_);
+    glyphs_ = std::move(parsed.glyphs);
+    line_starts_ = std::move(parsed.line_starts);
+    // A final newline ends the last line rather than starting an empty one.
+    if (!text_.empty() && text_.back() == '\n' && line_starts_.size() > 1) {
+        line_starts_.pop_back();
+    }
+    line_starts_.push_back(glyphs_.size());
+
+    style_table_ = std::move(parsed.styles);
+    styles_.assign(glyphs_.size(), 0);
+    for (const AnsiSegment& segment : parsed.segments) {
+        std::fill(styles_.begin() + segment.glyph_begin, styles_.begin() + segment.glyph_end, segment.style);
+    }
+}
+
+std::shared_ptr<AnsiDocument> AnsiDocument::Get(const std::string& text) {
+    // Most recently used first. One cache per thread, so no locking.
+    thread_local std::vector<std::shared_ptr<AnsiDocument>> cache;
+    for (size_t i = 0; i < cache.size(); ++i) {
+        if (cache[i]->text_ == text) {
+            std::rotate(cache.begin(), cache.begin() + i, cache.begin() + i + 1);
+            return cache.front();
+        }
+    }
+    cache.insert(cache.begin(), std::make_shared<AnsiDocument>(text));
+    if (cache.size() > kCachedDocuments) {
+        cache.pop_back();
+    }
+    return cache.front();
+}
+
+const std::string& AnsiDocument::text() const {
+    return text_;
+}
+
+const std::vector<std::string>& AnsiDocument::glyphs() const {
+    return glyphs_;
+}
+
+const std::vector<uint32_t>& AnsiDocument::styles() const {
+    return styles_;
+}
+
+const std::vector<AnsiStyle>& AnsiDocument::style_table() const {
+    return style_table_;
+}
+
+int AnsiDocument::Wrap(int width, std::vector<AnsiRow>& rows) const {
+    rows.clear();
+    const size_t limit = static_cast<size_t>(std::max(width, 0));
+    for (size_t line = 0; line + 1 < line_starts_.size(); ++line) {
+        size_t begin = line_starts_[line];
+        const size_t end = line_starts_[line + 1];
+        while (limit > 0 && end - begin > limit) {
+            // Break at the last space that fits, the space itself isn't drawn.
+            const size_t cut = begin + limit;
+            size_t space = cut;
+            while (space > begin && glyphs_[space] != " ") {
+                --space;
+            }
+            if (space > begin) {
+                rows.push_back(AnsiRow{begin, space, false});
+                begin = space + 1;
+            }
+            else {
+                rows.push_back(AnsiRow{begin, cut, false});
+                begin = cut;
+            }
+        }
+        rows.push_back(AnsiRow{begin, end, true});
+    }
+    int columns = 0;
+    for (const AnsiRow& row : rows) {
+        columns = std::max(columns, static_cast<int>(row.end - row.begin));
+    }
+    return columns;
+}
+
+AnsiBlock::AnsiBlock(std::shared_ptr<const AnsiDocument> document, AnsiAlign align)
+    : document_(std::move(document)), align_(align) {
+}
+
+const std::vector<AnsiRow>& AnsiBlock::Rows(int width) {
+    width = std::max(width, 0);
+    if (width != wrapped_width_) {
+        wrapped_columns_ = document_->Wrap(width, rows_);
+        wrapped_width_ = width;
+    }
+    return rows_;
+}
+
+void AnsiBlock::ComputeRequirement() {
+    // Unwrapped on the first pass, then sized for the width SetBox gave; SetBox asks for
+    // another pass when that changes the row count.
+    const std::vector<AnsiRow>& rows = Rows(std::max(wrapped_width_, 0));
+    requirement_.min_x = wrapped_columns_;
+    requirement_.min_y = static_cast<int>(rows.size());
+    requirement_.flex_grow_x = 1;
+    requirement_.flex_shrink_x = 1;
+    has_selection_ = false;
+}
+
+void AnsiBlock::SetBox(Box box) {
+    Node::SetBox(box);
+    const std::vector<AnsiRow>& rows = Rows(box.x_max - box.x_min + 1);
+    need_iteration_ = static_cast<int>(rows.size()) != requirement_.min_y;
+}
+
+void AnsiBlock::Check(Status* status) {
+    Node::Check(status);
+    status->need_iteration |= need_iteration_;
+}
+
+template <typename F>
+void AnsiBlock::ForEachCell(const AnsiRow& row, F&& f) const {
+    const std::vector<std::string>& glyphs = document_->glyphs();
+    const int width = box_.x_max - box_.x_min + 1;
+    const int extra = width - static_cast<int>(row.end - row.begin);
+    int x = 0;
+    int spaces = 0;
+    if (extra > 0 && align_ == AnsiAlign::Right) {
+        x = extra;
+    }
+    else if (extra > 0 && align_ == AnsiAlign::Center) {
+        x = extra / 2;
+    }
+    else if (extra > 0 && align_ == AnsiAlign::Justify && !row.last) {
+        spaces = static_cast<int>(std::count(glyphs.begin() + row.begin, glyphs.begin() + row.end, " "));
+    }
+    int space = 0;
+    for (size_t g = row.begin; g < row.end && x < width; ++g) {
+        f(x, g);
+        ++x;
+        if (spaces > 0 && glyphs[g] == " ") {
+            // The first extra % spaces gaps take one more cell than the rest.
+            x += extra / spaces + (space < extra % spaces ? 1 : 0);
+            ++space;
+        }
+    }
+}
+
+void AnsiBlock::Select(Selection& selection) {
+    if (Box::Intersection(selection.GetBox(), box_).IsEmpty()) {
+        return;
+    }
+    Selection vertical = selection.SaturateVertical(box_);
+    const std::vector<std::string>& glyphs = document_->glyphs();
+    const std::vector<AnsiRow>& rows = Rows(box_.x_max - box_.x_min + 1);
+    const int visible = std::min(static_cast<int>(rows.size()), box_.y_max - box_.y_min + 1);
+
+    has_selection_ = true;
+    selection_.assign(std::max(visible, 0), Box{0, -1, 0, -1});
+    for (int r = 0; r < visible; ++r) {
+        const Box line{box_.x_min, box_.x_max, box_.y_min + r, box_.y_min + r};
+        if (Box::Intersection(vertical.GetBox(), line).IsEmpty()) {
+            continue;
+        }
+        const Box range = vertical.SaturateHorizontal(line).GetBox();
+        selection_[r] = range;
+        std::string part;
+        ForEachCell(rows[r], [&](int x, size_t g) {
+            if (range.x_min <= box_.x_min + x && box_.x_min + x <= range.x_max) {
+                part += glyphs[g];
+            }
+        });
+        selection.AddPart(part, line.y_min, range.x_min, range.x_max);
+    }
+}
+
+void AnsiBlock::Render(Screen& screen) {
+    const std::vector<std::string>& glyphs = document_->glyphs();
+    const std::vector<uint32_t>& styles = document_->styles();
+    const std::vector<AnsiStyle>& style_table = document_->style_table();
+    const std::vector<AnsiRow>& rows = Rows(box_.x_max - box_.x_min + 1);
+    const int visible = std::min(static_cast<int>(rows.size()), box_.y_max - box_.y_min + 1);
+
+    for (int r = 0; r < visible; ++r) {
+        const int y = box_.y_min + r;
+        const bool row_selected = has_selection_ && r < static_cast<int>(selection_.size());
+        ForEachCell(rows[r], [&](int x, size_t g) {
+            auto& pixel = screen.PixelAt(box_.x_min + x, y);
+            pixel.character = glyphs[g];
+            if (styles[g] != 0) {
+                ApplyStyle(style_table[styles[g]], pixel);
+            }
+            if (row_selected && selection_[r].x_min <= box_.x_min + x && box_.x_min + x <= selection_[r].x_max) {
+                screen.GetSelectionStyle()(pixel);
+            }
+        });
+    }
+}
+
+Element ansi_block(const std::string& text, AnsiAlign align) {
+    return std::make_shared<AnsiBlock>(AnsiDocument::Get(text), align);
+}
+
+}  // namespace ftxui
@@ -9,10 +9,7 @@
 #include "color_utils.hpp"
 #include "ascii_image.hpp"
 #include "ascii_generator.hpp"
-#include "ansi_text.hpp"
-#include <ansi_paragraph.hpp>
-#include <iostream>
-#include <sstream>
+#include "ascii_image_node.hpp"
 using namespace ftxui;
 
 int main() {
@@ -20,13 +17,11 @@ int main() {
     
     auto generator = AsciiGenerator();
     auto image = generator.generate_ascii_from_file("images/tree.jpg",100,100);
-    std::stringstream ss;
-    ss << image;
     
     
     auto component = Renderer([&] {
         return vbox({
-            ansi_paragraph(ss.str())
+            ascii_image(image)
         }) | border;
     });
     
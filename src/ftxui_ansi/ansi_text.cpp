@@ -1,80 +1,265 @@
 #include "ansi_text.hpp"
-#include <regex>
+#include "frame_trace.hpp"
 #include <memory>
 #include <algorithm>
+#include <unordered_map>
 
 namespace ftxui {
 
-AnsiText::AnsiText(std::string text) : text_(std::move(text)) {
-    ParseAnsiText();
-    visible_width_ = CalculateVisibleWidth(text_);
+namespace {
+
+constexpr char kEscape = '\x1b';
+constexpr char kBell = '\x07';
+
+// Returns the index just past the escape sequence starting at text[start].
+size_t SkipEscape(const std::string& text, size_t start) {
+    const size_t n = text.size();
+    size_t i = start + 1;
+    if (i >= n) {
+        return n;
+    }
+    const char kind = text[i++];
+    if (kind == '[') {
+        // CSI: parameter bytes 0x30-0x3F, intermediate bytes 0x20-0x2F, one final byte 0x40-0x7E.
+        while (i < n && text[i] >= 0x20 && text[i] <= 0x3F) {
+            ++i;
+        }
+        return (i < n) ? i + 1 : n;
+    }
+    if (kind == ']') {
+        // OSC: terminated by BEL or ST (ESC \).
+        while (i < n) {
+            if (text[i] == kBell) {
+                return i + 1;
+            }
+            if (text[i] == kEscape && i + 1 < n && text[i + 1] == '\\') {
+                return i + 2;
+            }
+            ++i;
+        }
+        return n;
+    }
+    return i;  // Two byte escape such as ESC 7.
 }
 
-void AnsiText::ParseAnsiText() {
-    segments_.clear();
-    
-    std::string current_text;
-    std::string current_ansi;
-    bool in_escape = false;
-    std::string escape_buffer;
-    
-    for (size_t i = 0; i < text_.length(); ++i) { // for each character in the string
-        char c = text_.at(i);
-        
-        
-        if (c == '\033' || c == '\x1b') {// Detect start of ANSI escape sequence (\033 or \x1b)
-            
-            if (!current_text.empty()) { // if its not empty
-                segments_.push_back({current_text, current_ansi}); // push the string of characters and the ansi command
-                current_text.clear();
+// Parse-time style, packed so it can be interned by value.
+// Colours are kind << 24 | value, kind 0 unset, 1 palette 16, 2 palette 256, 3 RGB.
+struct SgrState {
+    enum Flag : uint8_t {
+        kBold = 1 << 0,
+        kDim = 1 << 1,
+        kItalic = 1 << 2,
+        kUnderlined = 1 << 3,
+        kUnderlinedDouble = 1 << 4,
+        kBlink = 1 << 5,
+        kInverted = 1 << 6,
+        kStrikethrough = 1 << 7,
+    };
+    uint32_t foreground = 0;
+    uint32_t background = 0;
+    uint8_t flags = 0;
+
+    uint64_t key() const {
+        return static_cast<uint64_t>(foreground) << 34 | static_cast<uint64_t>(background) << 8 | flags;
+    }
+};
+
+constexpr uint32_t kPalette16 = 1u << 24;
+constexpr uint32_t kPalette256 = 2u << 24;
+constexpr uint32_t kRgb = 3u << 24;
+// Parameters past this many in one sequence are ignored.
+constexpr int kMaxSgrParams = 32;
+
+// Extended colour after 38 or 48 ("5;n" or "2;r;g;b"), advances i past what it used.
+uint32_t ExtendedColor(const int* params, int count, int& i) {
+    if (i + 2 < count && params[i + 1] == 5) {
+        i += 2;
+        return kPalette256 | static_cast<uint32_t>(std::clamp(params[i], 0, 255));
+    }
+    if (i + 4 < count && params[i + 1] == 2) {
+        const uint32_t r = std::clamp(params[i + 2], 0, 255);
+        const uint32_t g = std::clamp(params[i + 3], 0, 255);
+        const uint32_t b = std::clamp(params[i + 4], 0, 255);
+        i += 4;
+        return kRgb | r << 16 | g << 8 | b;
+    }
+    i = count;
+    return 0;
+}
+
+// Applies the SGR sequence text[begin, end) ("ESC [ params m") to state.
+void ApplySgr(const std::string& text, size_t begin, size_t end, SgrState& state) {
+    int params[kMaxSgrParams];
+    int count = 0;
+    int value = 0;
+    // ':' separated sub-parameters ("38:2:r:g:b") are read like ';' ones.
+    for (size_t i = begin + 2; i < end; ++i) {
+        const char c = text[i];
+        if (c >= '0' && c <= '9') {
+            value = std::min(value * 10 + (c - '0'), 65535);
+        }
+        else if (c == ';' || c == ':' || c == 'm') {
+            if (count < kMaxSgrParams) {
+                params[count++] = value;
             }
-            
-            in_escape = true;
-            escape_buffer = std::string(1,c);
-            continue;
+            value = 0;
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        const int p = params[i];
+        switch (p) {
+            case 0:  state = SgrState(); break;
+            case 1:  state.flags |= SgrState::kBold; break;
+            case 2:  state.flags |= SgrState::kDim; break;
+            case 3:  state.flags |= SgrState::kItalic; break;
+            case 4:  state.flags |= SgrState::kUnderlined; break;
+            case 5:
+            case 6:  state.flags |= SgrState::kBlink; break;
+            case 7:  state.flags |= SgrState::kInverted; break;
+            case 9:  state.flags |= SgrState::kStrikethrough; break;
+            case 21: state.flags |= SgrState::kUnderlinedDouble; break;
+            case 22: state.flags &= ~(SgrState::kBold | SgrState::kDim); break;
+            case 23: state.flags &= ~SgrState::kItalic; break;
+            case 24: state.flags &= ~(SgrState::kUnderlined | SgrState::kUnderlinedDouble); break;
+            case 25: state.flags &= ~SgrState::kBlink; break;
+            case 27: state.flags &= ~SgrState::kInverted; break;
+            case 29: state.flags &= ~SgrState::kStrikethrough; break;
+            case 38: state.foreground = ExtendedColor(params, count, i); break;
+            case 39: state.foreground = 0; break;
+            case 48: state.background = ExtendedColor(params, count, i); break;
+            case 49: state.background = 0; break;
+            default:
+                if (p >= 30 && p <= 37) {
+                    state.foreground = kPalette16 | (p - 30);
+                }
+                else if (p >= 40 && p <= 47) {
+                    state.background = kPalette16 | (p - 40);
+                }
+                else if (p >= 90 && p <= 97) {
+                    state.foreground = kPalette16 | (p - 90 + 8);
+                }
+                else if (p >= 100 && p <= 107) {
+                    state.background = kPalette16 | (p - 100 + 8);
+                }
+                break;
+        }
+    }
+}
+
+Color ToColor(uint32_t packed) {
+    const uint32_t value = packed & 0xffffff;
+    switch (packed & 0xff000000) {
+        case kPalette16:  return Color(static_cast<Color::Palette16>(value));
+        case kPalette256: return Color(static_cast<Color::Palette256>(value));
+        default:          return Color::RGB(value >> 16, (value >> 8) & 0xff, value & 0xff);
+    }
+}
+
+AnsiStyle ToStyle(const SgrState& state) {
+    AnsiStyle style;
+    style.has_foreground = state.foreground != 0;
+    style.has_background = state.background != 0;
+    if (style.has_foreground) {
+        style.foreground = ToColor(state.foreground);
+    }
+    if (style.has_background) {
+        style.background = ToColor(state.background);
+    }
+    style.bold = state.flags & SgrState::kBold;
+    style.dim = state.flags & SgrState::kDim;
+    style.italic = state.flags & SgrState::kItalic;
+    style.underlined = state.flags & SgrState::kUnderlined;
+    style.underlined_double = state.flags & SgrState::kUnderlinedDouble;
+    style.blink = state.flags & SgrState::kBlink;
+    style.inverted = state.flags & SgrState::kInverted;
+    style.strikethrough = state.flags & SgrState::kStrikethrough;
+    return style;
+}
+
+}  // namespace
+
+void ApplyStyle(const AnsiStyle& style, Pixel& pixel) {
+    if (style.has_foreground) {
+        pixel.foreground_color = style.foreground;
+    }
+    if (style.has_background) {
+        pixel.background_color = style.background;
+    }
+    pixel.bold |= style.bold;
+    pixel.dim |= style.dim;
+    pixel.italic |= style.italic;
+    pixel.underlined |= style.underlined;
+    pixel.underlined_double |= style.underlined_double;
+    pixel.blink |= style.blink;
+    pixel.inverted |= style.inverted;
+    pixel.strikethrough |= style.strikethrough;
+}
+
+AnsiParseResult ParseAnsi(const std::string& text) {
+    frame_trace::Scope scope("ansi_parse");
+    AnsiParseResult result;
+    // Each distinct style is parsed into the table once, segments refer to it by index.
+    SgrState state;
+    uint32_t current_style = 0;
+    std::unordered_map<uint64_t, uint32_t> interned{{SgrState().key(), 0}};
+    result.styles.emplace_back();
+    const size_t n = text.size();
+    size_t run_start = 0;
+    result.line_starts.push_back(0);
+
+    // Turns text[run_start, end) into a segment and its glyphs.
+    auto flush = [&](size_t end) {
+        if (end > run_start) {
+            AnsiSegment segment;
+            segment.text.assign(text, run_start, end - run_start);
+            segment.style = current_style;
+            segment.glyph_begin = result.glyphs.size();
+            for (auto& glyph : Utf8ToGlyphs(segment.text)) {
+                result.glyphs.push_back(std::move(glyph));
+            }
+            segment.glyph_end = result.glyphs.size();
+            result.visible_width += string_width(segment.text);
+            result.segments.push_back(std::move(segment));
         }
-        
-        
-        if (in_escape) {// If we're in an escape sequence, start collecting 
-            escape_buffer += c;
+    };
+
+    size_t i = 0;
+    while (i < n) {
+        const char c = text[i];
+        if (c == kEscape) {
+            flush(i);
+            const size_t end = SkipEscape(text, i);
             // ANSI SGR codes end with 'm'
-            if (c == 'm') {
-                current_ansi = escape_buffer;
-                in_escape = false;
-                escape_buffer.clear();
+            if (end - i >= 3 && text[i + 1] == '[' && text[end - 1] == 'm') {
+                ApplySgr(text, i, end, state);
+                auto found = interned.find(state.key());
+                if (found == interned.end()) {
+                    found = interned.emplace(state.key(), static_cast<uint32_t>(result.styles.size())).first;
+                    result.styles.push_back(ToStyle(state));
+                }
+                current_style = found->second;
             }
+            i = run_start = end;
             continue;
         }
-        
-        // Regular character - add to current text
         if (c == '\n') {
             // Don't include newlines (AnsiText is single-line like Text, newlines will be handled by a ansiparagraph.
+            flush(i);
+            result.line_starts.push_back(result.glyphs.size());
+            i = run_start = i + 1;
             continue;
         }
-        current_text += c;
+        ++i;
     }
-    
-    // Save any remaining text
-    if (!current_text.empty()) {
-        segments_.push_back({current_text, current_ansi});
-    }
-}
-
-int AnsiText::CalculateVisibleWidth(const std::string& text) {
-    std::string stripped = StripAnsiCodes(text);
-    // Remove newlines for width calculation
-    stripped.erase(std::remove(stripped.begin(), stripped.end(), '\n'), stripped.end()); // remove everything after the first newline as that won't be visable.
-    return string_width(stripped);
+    flush(n);
+    return result;
 }
 
-std::string AnsiText::StripAnsiCodes(const std::string& text) {
-    // Remove ANSI escape sequences: \033[...m or \x1b[...m
-    std::regex ansi_regex(R"(\x1b\[[0-9;]*m|\033\[[0-9;]*m)");
-    return std::regex_replace(text, ansi_regex, "");
+AnsiText::AnsiText(std::string text) : text_(std::move(text)), parsed_(ParseAnsi(text_)) {
 }
 
 void AnsiText::ComputeRequirement() {
-    requirement_.min_x = visible_width_;
+    requirement_.min_x = parsed_.visible_width;
     requirement_.min_y = 1;
     has_selection = false;
 }
@@ -94,11 +279,7 @@ void AnsiText::Select(Selection& selection) {
     int x = box_.x_min;
     
     // Only select visible characters
-    std::string visible = StripAnsiCodes(text_);
-    for (const auto& cell : Utf8ToGlyphs(visible)) {
-        if (cell == "\n") {
-            continue;
-        }
+    for (const auto& cell : parsed_.glyphs) {
         if (selection_start_ <= x && x <= selection_end_) {
             ss << cell;
         }
@@ -115,24 +296,20 @@ void AnsiText::Render(Screen& screen) {
         return;
     }
 
-    // Render each segment with its ANSI code
-    for (const auto& segment : segments_) {
-        // Convert segment text to glyphs
-        for (const auto& cell : Utf8ToGlyphs(segment.text)) {
+    // Render each segment with its style
+    for (const auto& segment : parsed_.segments) {
+        for (size_t g = segment.glyph_begin; g < segment.glyph_end; ++g) {
+            const std::string& cell = parsed_.glyphs[g];
             if (x > box_.x_max) {
                 return;  // Don't render beyond bounds
             }
             
             auto& pixel = screen.PixelAt(x, y);
             
-            // Set the character
+            // Glyphs fit the small string buffer, so neither step allocates.
             pixel.character = cell;
-            
-            // Apply ANSI color by embedding it in the character string
-            // When FTXUI outputs to terminal, it will preserve the ANSI codes
-            if (!segment.ansi_code.empty()) {
-                // Embed ANSI code with character
-                pixel.character = segment.ansi_code + cell + "\033[0m";
+            if (segment.style != 0) {
+                ApplyStyle(parsed_.styles[segment.style], pixel);
             }
             
             // Handle selection
@@ -0,0 +1,50 @@
+#include "ascii_image_node.hpp"
+#include <algorithm>
+#include <memory>
+
+namespace ftxui {
+
+AsciiImageNode::AsciiImageNode(AsciiImage image) : image_(std::move(image)) {
+}
+
+void AsciiImageNode::ComputeRequirement() {
+    const cv::Mat4b& cells = image_.get_cells();
+    requirement_.min_x = cells.cols;
+    requirement_.min_y = cells.rows;
+}
+
+void AsciiImageNode::Render(Screen& screen) {
+    const cv::Mat4b& cells = image_.get_cells();
+    const bool color = image_.has_color();
+    const PaletteMode mode = image_.get_palette();
+    const Palette* palette = mode == PaletteMode::TrueColor ? nullptr : &Palette::get(mode);
+    const int rows = std::min(cells.rows, box_.y_max - box_.y_min + 1);
+    const int cols = std::min(cells.cols, box_.x_max - box_.x_min + 1);
+
+    for (int y = 0; y < rows; ++y) {
+        const uchar* cell = cells.ptr<uchar>(y);
+        for (int x = 0; x < cols; ++x, cell += 4) {
+            auto& pixel = screen.PixelAt(box_.x_min + x, box_.y_min + y);
+            // A single byte fits the small string buffer, so this never allocates.
+            pixel.character.assign(1, static_cast<char>(cell[3]));
+            if (!color) {
+                continue;
+            }
+            if (!palette) {
+                pixel.foreground_color = Color::RGB(cell[0], cell[1], cell[2]);
+            }
+            else if (mode == PaletteMode::Ansi256) {
+                pixel.foreground_color = Color(static_cast<Color::Palette256>(palette->index(cell[0], cell[1], cell[2])));
+            }
+            else {
+                pixel.foreground_color = Color(static_cast<Color::Palette16>(palette->index(cell[0], cell[1], cell[2])));
+            }
+        }
+    }
+}
+
+Element ascii_image(AsciiImage image) {
+    return std::make_shared<AsciiImageNode>(std::move(image));
+}
+
+}  // namespace ftxui
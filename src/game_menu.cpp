@@ -1,63 +1,593 @@
 #include <game_menu.hpp>
 
-#include <thread>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
 using namespace std::chrono_literals;
 
+namespace {
+
+double millisecondsBetween(DisplayHUD::Clock::time_point from, DisplayHUD::Clock::time_point to){
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// How often the stats panel text is rebuilt while it is shown.
+constexpr std::chrono::milliseconds kStatsRefresh{250};
+
+std::string formatRow(const char* label, double p50, double p99){
+    char row[64];
+    std::snprintf(row, sizeof(row), "%-16s %7.2f %7.2f\n", label, p50, p99);
+    return row;
+}
+
+// Characters only, styles would make golden files depend on colour output details.
+bool writeScreenText(const Screen& screen, const std::string& path){
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    for (int y = 0; y < screen.dimy(); ++y) {
+        for (int x = 0; x < screen.dimx(); ++x) {
+            out << screen.PixelAt(x, y).character;
+        }
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+DisplayHUD::Clock::duration period(double per_second){
+    return std::chrono::duration_cast<DisplayHUD::Clock::duration>(std::chrono::duration<double>(1.0 / per_second));
+}
+
+}  // namespace
+
+void SampleRing::add(double ms){
+    samples[next] = ms;
+    next = (next + 1) % samples.size();
+    filled = std::min(filled + 1, samples.size());
+}
+
+double SampleRing::percentile(double p) const{
+    if (filled == 0) {
+        return 0;
+    }
+    std::array<double, 512> sorted = samples;
+    const size_t index = std::min(filled - 1, static_cast<size_t>(p * filled));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + filled);
+    return sorted[index];
+}
+
+size_t SampleRing::count() const{
+    return filled;
+}
+
+AsciiImage& GridRing::next(){
+    // A grid nobody else holds, else the next one in turn, which the stage then replaces.
+    for (size_t i = 1; i <= grids.size(); ++i) {
+        const size_t candidate = (current + i) % grids.size();
+        if (!grids[candidate].is_shared()) {
+            current = candidate;
+            return grids[current];
+        }
+    }
+    current = (current + 1) % grids.size();
+    return grids[current];
+}
+
+const AsciiImage& GridRing::latest() const{
+    return grids[current];
+}
+
 DisplayHUD::DisplayHUD(): 
 screen(ScreenInteractive::Fullscreen())
 {
     top_level_component = menu.Top_Component();
+    // Baked levels that fit the panel beat decoding the still on every resize.
+    generator.set_prefer_baked(true);
+    background_layer = compositor.add_layer(AsciiImage(AsciiImageData()), cv::Point(), std::numeric_limits<int>::min());
 
 
     renderer = Renderer(top_level_component,[this](){
         return(this->render());
     });
+    // Timestamp real input for the latency measurement, the worker's refresh events don't count.
+    renderer = CatchEvent(renderer, [this](Event event){
+        if (event != Event::Custom && !pending_input) {
+            pending_input = Clock::now();
+        }
+        if (event == Event::F3) {
+            exportTrace("hud_trace.json");
+            return true;
+        }
+        return false;
+    });
+}
+
+DisplayHUD::~DisplayHUD(){
+    stop();
+}
+
+void DisplayHUD::setTiming(const HudTiming& new_timing){
+    timing = new_timing;
+}
+
+void DisplayHUD::setTickHandler(std::function<void(double)> handler){
+    tick_handler = std::move(handler);
+}
+
+void DisplayHUD::setTone(const ToneSettings& settings){
+    generator.set_tone(settings);
+    video.set_tone(settings);
+    tone_changed = true;
+    wake.notify_all();
+}
+
+void DisplayHUD::setGlyphMode(GlyphMode mode){
+    generator.set_glyph_mode(mode);
+    video.set_glyph_mode(mode);
+    glyph_mode = mode;
+    // Converted again like a tone change.
+    tone_changed = true;
+    wake.notify_all();
+}
+
+HudStats DisplayHUD::stats() const{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    HudStats result = counters;
+    result.frame_time_p50_ms = frame_times.percentile(0.5);
+    result.frame_time_p99_ms = frame_times.percentile(0.99);
+    result.frame_interval_p50_ms = frame_intervals.percentile(0.5);
+    result.frame_interval_p99_ms = frame_intervals.percentile(0.99);
+    result.input_latency_p50_ms = input_latencies.percentile(0.5);
+    result.input_latency_p99_ms = input_latencies.percentile(0.99);
+    result.resize_latency_p50_ms = resize_latencies.percentile(0.5);
+    result.resize_latency_p99_ms = resize_latencies.percentile(0.99);
+    return result;
+}
+
+bool DisplayHUD::exportTrace(const std::string& path) const{
+    return frame_trace::write_chrome_trace(path);
+}
+
+Compositor& DisplayHUD::scene(){
+    return compositor;
+}
+
+EffectChain& DisplayHUD::effects(){
+    return effect_chain;
+}
+
+Raycaster& DisplayHUD::view(){
+    return raycaster;
+}
+
+LightMap& DisplayHUD::lighting(){
+    return light_map;
+}
+
+void DisplayHUD::setBackground(const AsciiImage& image, const GlyphLut& lut, bool shape_glyphs){
+    const cv::Mat4b& cells = image.get_cells();
+    if (compositor.size() != cv::Size(cells.cols, cells.rows)) {
+        compositor.resize(cv::Size(cells.cols, cells.rows));
+    }
+    compositor.set_image(background_layer, image);
+    background_greyscale = image.is_greyscale();
+    background_lut = lut;
+    background_shape = shape_glyphs;
+}
+
+std::string DisplayHUD::statsText() const{
+    const HudStats hud = stats();
+    std::string result = "stage (ms)           p50     p99\n";
+    result += formatRow("frame build", hud.frame_time_p50_ms, hud.frame_time_p99_ms);
+    result += formatRow("frame interval", hud.frame_interval_p50_ms, hud.frame_interval_p99_ms);
+    result += formatRow("input latency", hud.input_latency_p50_ms, hud.input_latency_p99_ms);
+    for (const frame_trace::StageStats& stage : frame_trace::stage_stats()) {
+        result += formatRow(stage.name.c_str(), stage.p50_ms, stage.p99_ms);
+    }
+    result += "F2 hide  F3 export trace";
+    return result;
 }
 
 void DisplayHUD::loop(){
-    // Start a background thread to update the menu content
-    std::thread update_thread([this]() {this->updateScreen();});
-    // Detach the thread so it runs independently
-    update_thread.detach();
+    frame_trace::set_thread_name("ui");
+    start();
     
     // Start the main UI loop
     screen.Loop(renderer);
+    stop();
+}
+
+HeadlessReport DisplayHUD::runHeadless(const HeadlessOptions& options){
+    headless = true;
+    frame_trace::set_thread_name("ui");
+    start();
+
+    std::vector<HeadlessStep> script = options.script;
+    std::stable_sort(script.begin(), script.end(), [](const HeadlessStep& a, const HeadlessStep& b) {
+        return a.frame < b.frame;
+    });
+    Screen offscreen = Screen::Create(Dimension::Fixed(options.size.width), Dimension::Fixed(options.size.height));
+    SampleRing render_times;
+    HeadlessReport report;
+    size_t next_step = 0;
+    const Clock::time_point run_start = Clock::now();
+    for (int i = 0; i < options.frames; ++i) {
+        for (; next_step < script.size() && script[next_step].frame <= i; ++next_step) {
+            const HeadlessStep& step = script[next_step];
+            if (step.resize) {
+                offscreen = Screen::Create(Dimension::Fixed(step.resize->width), Dimension::Fixed(step.resize->height));
+            }
+            if (step.event) {
+                renderer->OnEvent(*step.event);
+            }
+        }
+        const bool dump = std::find(options.dump_frames.begin(), options.dump_frames.end(), i) != options.dump_frames.end();
+        if (dump) {
+            // Otherwise what a dump shows would depend on how far the worker got.
+            settle(offscreen, options.settle_timeout);
+        }
+
+        const Clock::time_point render_start = Clock::now();
+        offscreen.Clear();
+        Render(offscreen, renderer->Render());
+        // Building the terminal string is part of what a real frame costs.
+        report.bytes += offscreen.ToString().size();
+        render_times.add(millisecondsBetween(render_start, Clock::now()));
+        report.frames++;
+
+        if (dump) {
+            const std::string path = options.dump_prefix + std::to_string(i) + ".txt";
+            if (writeScreenText(offscreen, path)) {
+                report.dumps.push_back(path);
+            }
+            else {
+                std::cerr << "Error: Could not write " << path << std::endl;
+            }
+        }
+    }
+    report.seconds = std::chrono::duration<double>(Clock::now() - run_start).count();
+    report.fps = report.seconds > 0 ? report.frames / report.seconds : 0;
+    report.render_p50_ms = render_times.percentile(0.5);
+    report.render_p99_ms = render_times.percentile(0.99);
+
+    stop();
+    return report;
+}
+
+void DisplayHUD::settle(Screen& offscreen, Clock::duration timeout){
+    const Clock::time_point deadline = Clock::now() + timeout;
+    while (true) {
+        Render(offscreen, renderer->Render());
+        HudLayout laid_out;
+        laid_out.screen_box = menu.screen_box;
+        if (menu.frame->screen_size == screenImageSize(laid_out) && !menu.frame->screen_image.get_cells().empty()) {
+            return;
+        }
+        if (Clock::now() >= deadline) {
+            return;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+void DisplayHUD::start(){
+    // Start the scheduler and the still image converter
+    running = true;
+    worker = std::thread([this]() {
+        frame_trace::set_thread_name("hud worker");
+        this->updateScreen();
+    });
+    converter = std::thread([this]() {
+        frame_trace::set_thread_name("still converter");
+        this->convertLoop();
+    });
+}
+
+void DisplayHUD::stop(){
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        running = false;
+    }
+    wake.notify_all();
+    {
+        // Taking the lock orders the flag change before the converter's next predicate check.
+        std::lock_guard<std::mutex> lock(convert_mutex);
+    }
+    convert_wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (converter.joinable()) {
+        converter.join();
+    }
+}
+
+bool DisplayHUD::waitUntil(Clock::time_point deadline){
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    wake.wait_until(lock, deadline, [this] { return !running || convert_ready; });
+    return running;
 }
 
 Element DisplayHUD::render(){
-    // Simply return the rendered component without any delays
-    //! Can add stuff here if necessary in the future.
+    const Clock::time_point now = Clock::now();
+    // Hand the boxes from the last layout to the worker, then draw the newest frame it published.
+    HudLayout& layout = layouts.back();
+    layout.inventory_box = menu.inventory_box;
+    layout.screen_box = menu.screen_box;
+    layout.action_box = menu.action_box;
+    const cv::Size panel_size = screenImageSize(layout);
+    layouts.publish();
+    if (menu.screen_box != last_screen_box) {
+        last_screen_box = menu.screen_box;
+        if (!pending_resize) {
+            pending_resize = now;
+        }
+    }
+    menu.latch();
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (pending_input) {
+            input_latencies.add(millisecondsBetween(*pending_input, now));
+            pending_input.reset();
+        }
+        if (pending_resize && menu.frame->screen_size == panel_size) {
+            resize_latencies.add(millisecondsBetween(*pending_resize, now));
+            pending_resize.reset();
+        }
+    }
+    frame_trace::Scope scope("ui_layout");
     return top_level_component->Render();
 }
 
+void DisplayHUD::publish(const HudFrame& frame){
+    menu.frames.back() = frame;
+    menu.frames.publish();
+    // The slot handed back is only overwritten by the next publish, until then it would keep
+    // an old grid shared and make the compositor, lighting and effects copy instead of reuse.
+    menu.frames.back().screen_image = AsciiImage(AsciiImageData());
+    // Trigger a screen refresh
+    if (!headless) {
+        screen.PostEvent(Event::Custom);
+    }
+}
+
+void DisplayHUD::play(const std::string& source, double fps){
+    video.open(source, fps);
+}
+
+cv::Size DisplayHUD::screenImageSize(const HudLayout& layout) const{
+    return cv::Size((layout.screen_box.x_max-layout.screen_box.x_min)/3, layout.screen_box.y_max-layout.screen_box.y_min);
+}
+
+void DisplayHUD::requestConversion(cv::Size size){
+    {
+        std::lock_guard<std::mutex> lock(convert_mutex);
+        // A newer generation makes any conversion still running for an old size give up.
+        convert_request = ConversionRequest{size, ++convert_generation};
+    }
+    convert_wake.notify_one();
+}
+
+void DisplayHUD::convertLoop(){
+    while (true) {
+        ConversionRequest request;
+        {
+            std::unique_lock<std::mutex> lock(convert_mutex);
+            convert_wake.wait(lock, [this] { return !running || convert_request; });
+            if (!running) {
+                return;
+            }
+            request = *convert_request;
+            convert_request.reset();
+        }
+
+        auto cancelled = [this, &request] { return !running || convert_generation != request.generation; };
+        AsciiImage ascii = AsciiImage(AsciiImageData());
+        GlyphLut lut;
+        const bool shape_glyphs = glyph_mode == GlyphMode::Shape;
+        const bool done = generator.generate_ascii_from_file(still_path, request.size.width, request.size.height, false, cancelled, ascii, &lut);
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            if (done) {
+                counters.conversions++;
+            }
+            else if (cancelled()) {
+                counters.cancelled_conversions++;
+            }
+            else {
+                // The generator has reported it, the panel keeps its last image until the next refresh.
+                counters.failed_conversions++;
+            }
+        }
+        if (!done || cancelled()) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(convert_mutex);
+            convert_result = ConversionResult{request.generation, ascii, lut, shape_glyphs};
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            convert_ready = true;
+        }
+        wake.notify_all();
+    }
+}
+
 void DisplayHUD::updateScreen(){
-int i = 0;
-        while (true) {
-            std::this_thread::sleep_for(1000ms);
-            int image_x =( menu.screen_box.x_max-menu.screen_box.x_min)/3;
-            int image_y = (menu.screen_box.y_max-menu.screen_box.y_min);
-            // Update the menu text
-            menu.inventory_text = "Image size : " 
-            + std::to_string(image_x)+"   " 
-            + std::to_string(image_y);
-            
-            menu.action_text = "action size : " 
-            + std::to_string(menu.action_box.y_max-menu.action_box.y_min)+"   " 
-            + std::to_string(menu.action_box.x_max-menu.action_box.x_min);
+    const Clock::duration tick_step = period(timing.tick_rate);
+    const Clock::duration frame_step = period(timing.target_fps);
+    const double tick_seconds = std::chrono::duration<double>(tick_step).count();
 
+    HudFrame frame;
+    bool dirty = false;
+    cv::Size requested_size(-1, -1);   // size of the last conversion request
+    cv::Size seen_size(-1, -1);        // panel size as last observed
+    Clock::time_point size_changed_at = Clock::now();
+    Clock::time_point next_refresh = Clock::now();
+    Clock::time_point next_tick = Clock::now();
+    Clock::time_point next_frame = Clock::now();
+    std::optional<Clock::time_point> last_frame;
+    Clock::time_point next_stats = Clock::now();
+    uint64_t effect_frame = 0;
+    uint64_t light_frame = 0;
+    std::optional<uint64_t> drawn_view;   // raycaster revision in the background layer
 
-            // auto ascii = generator.generate_ascii_from_file("images/tree.jpg", menu.screen_box.x_max-menu.screen_box.x_min,menu.screen_box.y_max-menu.screen_box.y_min);
-            auto ascii = generator.generate_ascii_from_file("images/boat.jpg", image_x,image_y);
-            ascii.set_greyscale(false);
-            std::stringstream ss;
-            ss << ascii;
-            menu.screen_text = ss.str();
+    while (running) {
+        Clock::time_point now = Clock::now();
 
+        // Fixed step simulation, a backlog longer than max_ticks_per_frame is dropped.
+        int ticks = 0;
+        while (next_tick <= now && ticks < timing.max_ticks_per_frame) {
+            if (tick_handler) {
+                tick_handler(tick_seconds);
+            }
+            next_tick += tick_step;
+            ++ticks;
+        }
+        size_t skipped = 0;
+        if (next_tick <= now) {
+            skipped = static_cast<size_t>((now - next_tick) / tick_step) + 1;
+            next_tick = now + tick_step;
+        }
 
-            i++;
+        // Panel size changes regenerate as soon as the size has settled.
+        const HudLayout& layout = layouts.read();
+        const cv::Size size = screenImageSize(layout);
+        if (size != seen_size) {
+            seen_size = size;
+            size_changed_at = now;
+            frame.inventory_text = "Image size : " 
+            + std::to_string(size.width)+"   " 
+            + std::to_string(size.height);
             
-            // Trigger a screen refresh
-            screen.PostEvent(Event::Custom);
+            frame.action_text = "action size : " 
+            + std::to_string(layout.action_box.y_max-layout.action_box.y_min)+"   " 
+            + std::to_string(layout.action_box.x_max-layout.action_box.x_min);
+            dirty = true;
         }
-}
\ No newline at end of file
+        const bool playing = video.is_open() && !video.finished();
+        // The view is cheap enough to draw at every size the panel passes through.
+        const bool raycasting = raycaster.has_map() && !playing;
+        const bool settled = now - size_changed_at >= timing.resize_debounce;
+        if (tone_changed.exchange(false)) {
+            // Forces the still to be converted again with the new table.
+            requested_size = cv::Size(-1, -1);
+        }
+        if (playing) {
+            video.set_output_size(size.width, size.height);
+        }
+        else if (!raycasting && settled && size.width > 0 && size.height > 0 && (size != requested_size || now >= next_refresh)) {
+            requestConversion(size);
+            requested_size = size;
+            next_refresh = now + timing.still_refresh;
+        }
+
+        if (convert_ready) {
+            std::lock_guard<std::mutex> lock(convert_mutex);
+            {
+                std::lock_guard<std::mutex> wake_lock(wake_mutex);
+                convert_ready = false;
+            }
+            if (convert_result && convert_result->generation == convert_generation && !playing && !raycasting) {
+                setBackground(convert_result->image, convert_result->lut, convert_result->shape_glyphs);
+                frame.screen_size = requested_size;
+            }
+            convert_result.reset();
+        }
+
+        if (now >= next_frame) {
+            frame_trace::Scope scope("frame_build");
+            const Clock::time_point build_start = Clock::now();
+            if (playing) {
+                AsciiFrame video_frame;
+                // Cutscenes pace on frame timestamps
+                if (video.frame_for(now, video_frame)) {
+                    setBackground(video_frame.image, video_frame.lut, video_frame.shape_glyphs);
+                    frame.screen_size = size;
+                }
+            }
+            else if (raycasting && size.width > 0 && size.height > 0) {
+                const cv::Size cells(cvRound(size.width * AsciiImage::default_horizontal_scale), size.height);
+                if (drawn_view != raycaster.revision() || compositor.size() != cells) {
+                    raycaster.render(cells, raycast_output);
+                    setBackground(raycast_output, raycaster.lut(), false);
+                    frame.screen_size = size;
+                    drawn_view = raycaster.revision();
+                }
+            }
+            // Only the regions the background or a sprite changed are redrawn.
+            bool changed = compositor.compose();
+            const AsciiImage* shown = &compositor.image();
+            if (!light_map.empty() && !shown->get_cells().empty()) {
+                if (light_map.size() != compositor.size()) {
+                    light_map.resize(compositor.size());
+                }
+                // Only lights that moved or flickered are worked out again.
+                light_map.update(light_frame++);
+                if (changed || !light_map.updated_rects().empty()) {
+                    // Glyphs are picked again from the table the background was made with, shape
+                    // matched ones are kept and only darkened.
+                    light_map.apply(*shown, background_lut, lit_outputs.next(), !background_shape);
+                    changed = true;
+                }
+                shown = &lit_outputs.latest();
+            }
+            if (!effect_chain.empty() && !shown->get_cells().empty()) {
+                // Effects animate, so they run every frame even when nothing moved.
+                AsciiImage& effect_output = effect_outputs.next();
+                effect_chain.apply(*shown, effect_frame++, effect_output);
+                shown = &effect_output;
+                changed = true;
+            }
+            if (changed) {
+                dirty = true;
+            }
+            if (menu.show_stats && now >= next_stats) {
+                frame.stats_text = statsText();
+                next_stats = now + kStatsRefresh;
+                dirty = true;
+            }
+            if (dirty) {
+                // Only published frames hold the cells, the worker lets go of its copy right away.
+                frame.screen_image = *shown;
+                frame.screen_image.set_greyscale(background_greyscale);
+                publish(frame);
+                frame.screen_image = AsciiImage(AsciiImageData());
+                dirty = false;
+            }
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            frame_times.add(millisecondsBetween(build_start, Clock::now()));
+            if (last_frame) {
+                frame_intervals.add(millisecondsBetween(*last_frame, now));
+            }
+            last_frame = now;
+            counters.frames++;
+            next_frame += frame_step;
+            if (next_frame <= now) {
+                // Behind by more than a frame: skip ahead instead of bursting.
+                counters.skipped_frames += static_cast<size_t>((now - next_frame) / frame_step) + 1;
+                next_frame = now + frame_step;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            counters.ticks += ticks;
+            counters.skipped_ticks += skipped;
+        }
+
+        Clock::time_point deadline = std::min(next_tick, next_frame);
+        if (playing) {
+            deadline = std::min(deadline, video.next_deadline(now));
+        }
+        if (!settled) {
+            deadline = std::min(deadline, size_changed_at + timing.resize_debounce);
+        }
+        waitUntil(deadline);
+    }
+}
@@ -1,40 +1,159 @@
 #include "ascii_generator.hpp"
+#include "ascii_video.hpp"
+#include "terminal_renderer.hpp"
 #include <iostream>
 #include <string>
+#include <thread>
 
 #include <game_menu.hpp>
 
 
+// Cell width when none is given, as the usage text promises.
+constexpr int kDefaultWidth = 100;
 
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " <image_path> [width]" << std::endl;
+    std::cout << "       " << program_name << " --play <video_or_sequence> [width]" << std::endl;
     std::cout << "  image_path: Path to the input image file" << std::endl;
+    std::cout << "  --play:     Play a video, image sequence or glob, redrawing only changed cells" << std::endl;
     std::cout << "  width:      Optional ASCII art width (default: 100)" << std::endl;
+    std::cout << "  --palette:  truecolor (default), 256, 16 or mono, may follow any other argument" << std::endl;
+    std::cout << "  --dither:   none (default), ordered, fs or atkinson, may follow any other argument" << std::endl;
+}
+
+bool parse_dither(const std::string& name, DitherMode& mode) {
+    if (name == "none") {
+        mode = DitherMode::None;
+    }
+    else if (name == "ordered") {
+        mode = DitherMode::Ordered;
+    }
+    else if (name == "fs") {
+        mode = DitherMode::FloydSteinberg;
+    }
+    else if (name == "atkinson") {
+        mode = DitherMode::Atkinson;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Removes "name value" from the arguments, value is empty when name isn't there.
+// Returns false when name is the last argument.
+bool take_option(int& argc, char* argv[], const std::string& name, std::string& value) {
+    value.clear();
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != name) {
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        value = argv[i + 1];
+        for (int j = i; j + 2 <= argc; ++j) {
+            argv[j] = argv[j + 2];
+        }
+        argc -= 2;
+        break;
+    }
+    return true;
+}
+
+bool parse_palette(const std::string& name, PaletteMode& mode) {
+    if (name == "truecolor") {
+        mode = PaletteMode::TrueColor;
+    }
+    else if (name == "256") {
+        mode = PaletteMode::Ansi256;
+    }
+    else if (name == "16") {
+        mode = PaletteMode::Ansi16;
+    }
+    else if (name == "mono") {
+        mode = PaletteMode::Mono;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+int play(const std::string& source, int width, PaletteMode palette, DitherMode dither) {
+    AsciiVideoSource video;
+    if (!video.open(source)) {
+        return 1;
+    }
+    // Without a width the video would convert at its native resolution, thousands of columns wide.
+    if (width == -1) {
+        width = kDefaultWidth;
+    }
+    video.set_output_size(width, width);
+    video.set_dither(dither, palette);
+
+    TerminalRenderer renderer;
+    renderer.begin();
+    while (!video.finished()) {
+        const auto now = AsciiVideoSource::Clock::now();
+        AsciiFrame frame;
+        if (video.frame_for(now, frame)) {
+            frame.image.set_palette(palette);
+            if (!renderer.present(frame.image)) {
+                return 1;
+            }
+        }
+        std::this_thread::sleep_until(video.next_deadline(now));
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    // Take --palette and --dither out first so the positional arguments stay where they were.
+    PaletteMode palette = PaletteMode::TrueColor;
+    DitherMode dither = DitherMode::None;
+    std::string palette_name;
+    std::string dither_name;
+    if (!take_option(argc, argv, "--palette", palette_name) || !take_option(argc, argv, "--dither", dither_name) ||
+        (!palette_name.empty() && !parse_palette(palette_name, palette)) ||
+        (!dither_name.empty() && !parse_dither(dither_name, dither))) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
     if (argc < 2) {
         print_usage(argv[0]);
         return 1;
     }
     
-    std::string image_path = argv[1];
+    const bool play_mode = std::string(argv[1]) == "--play";
+    if (play_mode && argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string image_path = argv[play_mode ? 2 : 1];
     int width = -1;  // Use default width
     
-    if (argc >= 3) {
+    if (argc >= (play_mode ? 4 : 3)) {
         try {
-            width = std::stoi(argv[2]);
+            width = std::stoi(argv[play_mode ? 3 : 2]);
         } catch (const std::exception& e) {
             std::cerr << "Error: Invalid width parameter. Using default width." << std::endl;
             width = -1;
         }
     }
+
+    if (play_mode) {
+        return play(image_path, width, palette, dither);
+    }
     
     // Create ASCII generator with contrast=10
     AsciiGenerator generator;
+    generator.set_dither(dither, palette);
     
     try {
         auto ascii = generator.generate_ascii_from_file(image_path, width,width);
+        ascii.set_palette(palette);
         std::cout << ascii;
     } catch (const std::exception& e) {
         std::cerr << "Error generating ASCII art: " << e.what() << std::endl;
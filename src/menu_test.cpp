@@ -6,9 +6,103 @@
 #include "ftxui/component/screen_interactive.hpp"  // for ScreenInteractive
 #include "ftxui/dom/elements.hpp"  // for Element, operator|, text, center, border
 #include <game_menu.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
 using namespace ftxui;
+
+namespace {
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [video] [--raycast] [--headless frames] [--size WxH] [--resize frame:WxH]"
+              << " [--key frame:key] [--dump frame]" << std::endl;
+    std::cout << "  --raycast:  Show a first-person view of a small test map, turning slowly" << std::endl;
+    std::cout << "  --headless: Render this many frames offscreen as fast as possible and report fps" << std::endl;
+    std::cout << "  --size:     Offscreen size in cells (default: 160x48)" << std::endl;
+    std::cout << "  --resize:   Resize the offscreen screen before a frame, may repeat" << std::endl;
+    std::cout << "  --key:      Send F2, F3, an arrow (left/right/up/down) or a character before a frame, may repeat" << std::endl;
+    std::cout << "  --dump:     Write a frame as text to hud_frame_<frame>.txt, may repeat" << std::endl;
+}
+
+bool parse_size(const std::string& text, cv::Size& size) {
+    return std::sscanf(text.c_str(), "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0;
+}
+
+// "frame:rest", returns rest.
+bool parse_frame(const std::string& text, int& frame, std::string& rest) {
+    const size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    try {
+        frame = std::stoi(text.substr(0, colon));
+    } catch (const std::exception&) {
+        return false;
+    }
+    rest = text.substr(colon + 1);
+    return frame >= 0 && !rest.empty();
+}
+
+bool parse_key(const std::string& name, Event& event) {
+    if (name == "F2") {
+        event = Event::F2;
+    }
+    else if (name == "F3") {
+        event = Event::F3;
+    }
+    else if (name == "left") {
+        event = Event::ArrowLeft;
+    }
+    else if (name == "right") {
+        event = Event::ArrowRight;
+    }
+    else if (name == "up") {
+        event = Event::ArrowUp;
+    }
+    else if (name == "down") {
+        event = Event::ArrowDown;
+    }
+    else if (name.size() == 1) {
+        event = Event::Character(name);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Walls 2 and 3 are textured with the stills, wall 1 is left plain.
+void start_raycast_demo(DisplayHUD& hud) {
+    Raycaster& view = hud.view();
+    view.set_map({
+        "1111111111111111",
+        "1..............1",
+        "1..22....33....1",
+        "1..2......3....1",
+        "1..............1",
+        "1.....3..2.....1",
+        "1..............1",
+        "1111111111111111",
+    });
+    AsciiGenerator generator;
+    view.set_texture(2, generator.generate_ascii_from_file("images/tree.jpg", 16, 24));
+    view.set_texture(3, generator.generate_ascii_from_file("images/boat.jpg", 16, 24));
+    RayCamera camera;
+    camera.x = 7.5;
+    camera.y = 4.5;
+    view.set_camera(camera);
+    hud.setTickHandler([&hud](double seconds) {
+        RayCamera turned = hud.view().camera();
+        turned.angle += 0.4 * seconds;
+        hud.view().set_camera(turned);
+    });
+}
+
+}  // namespace
  
-int main() {
+int main(int argc, char* argv[]) {
 //   auto screen = ScreenInteractive::Fullscreen();
  
 //   auto middle = Renderer([] { return text("middle") | center; });
@@ -33,5 +127,65 @@ int main() {
  
 //   screen.Loop(renderer);
 DisplayHUD test;
-test.loop();
+HeadlessOptions headless;
+bool run_headless = false;
+for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    HeadlessStep step;
+    std::string rest;
+    if (arg == "--raycast") {
+        start_raycast_demo(test);
+    }
+    else if (arg == "--headless" && has_value) {
+        run_headless = true;
+        headless.frames = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--size" && has_value && parse_size(argv[i + 1], headless.size)) {
+        ++i;
+    }
+    else if (arg == "--resize" && has_value && parse_frame(argv[i + 1], step.frame, rest)) {
+        cv::Size size;
+        if (!parse_size(rest, size)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        step.resize = size;
+        headless.script.push_back(step);
+        ++i;
+    }
+    else if (arg == "--key" && has_value && parse_frame(argv[i + 1], step.frame, rest)) {
+        Event event = Event::Custom;
+        if (!parse_key(rest, event)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        step.event = event;
+        headless.script.push_back(step);
+        ++i;
+    }
+    else if (arg == "--dump" && has_value) {
+        headless.dump_frames.push_back(std::atoi(argv[++i]));
+    }
+    else if (arg == "--help" || arg.rfind("--", 0) == 0) {
+        print_usage(argv[0]);
+        return arg == "--help" ? 0 : 1;
+    }
+    else {
+        test.play(arg);
+    }
+}
+if (!run_headless) {
+    test.loop();
+    return 0;
+}
+
+const HeadlessReport report = test.runHeadless(headless);
+std::cout << report.frames << " frames in " << report.seconds << " s, " << report.fps << " fps" << std::endl;
+std::cout << "render p50 " << report.render_p50_ms << " ms, p99 " << report.render_p99_ms << " ms, "
+          << report.bytes / std::max(report.frames, 1) << " bytes/frame" << std::endl;
+for (const std::string& path : report.dumps) {
+    std::cout << "Wrote " << path << std::endl;
+}
+return 0;
 }
\ No newline at end of file